@@ -27,10 +27,14 @@ int main(int argc, char* argv[]) {
 
     string path = "";
     string algo = "";
+    // optional window of trace lines to analyze (1 based, inclusive), 0 means not given
+    ll from = 0, to = 0;
+    // RAM budget (MB) of the shadow memory, 0 means everything stays in memory
+    ll shadow_mb = 0;
 
-    if (argc != 3) {
+    if (argc < 3 || argc > 7) {
         cout << "The desired format of command line argument is:\n";
-        cout << "./a.out -algo=algo_name -trace=path_to_trace_file" << endl;
+        cout << "./a.out -algo=algo_name -trace=path_to_trace_file [-from=line] [-to=line] [-shadow_mb=MB] [-prescreen=on/off]" << endl;
         return 1;
     }
 
@@ -46,6 +50,34 @@ int main(int argc, char* argv[]) {
                 algo = value;
             } else if (key == "trace") {
                 path = value;
+            } else if (key == "from" || key == "to") {
+                ll line_no = 0;
+                try {
+                    line_no = stoll(value);
+                } catch (...) {
+                    line_no = -1;
+                }
+                if (line_no <= 0) {
+                    cout << "Invalid line number: " << arg << endl;
+                    return 1;
+                }
+                (key == "from" ? from : to) = line_no;
+            } else if (key == "prescreen") {
+                if (value != "on" && value != "off") {
+                    cout << "Invalid value for -prescreen (on/off): " << arg << endl;
+                    return 1;
+                }
+                prescreen_enabled = (value == "on");
+            } else if (key == "shadow_mb") {
+                try {
+                    shadow_mb = stoll(value);
+                } catch (...) {
+                    shadow_mb = -1;
+                }
+                if (shadow_mb <= 0) {
+                    cout << "Invalid shadow memory budget: " << arg << endl;
+                    return 1;
+                }
             } else {
                 cout << "Unknown argument: " << arg << endl;
                 return 1;
@@ -63,6 +95,20 @@ int main(int argc, char* argv[]) {
     }
 
     trace_file=parse_log(path);
+    // with a window we seek through the sync-event index instead of replaying from the start
+    bool windowed = (from > 0 || to > 0);
+    if (to > 0 && from > to) {
+        cout << "Empty window: -from must not be after -to" << endl;
+        return 1;
+    }
+    // out-of-core mode, cold shadow pages go to a spill file next to the trace
+    if (shadow_mb > 0) {
+        size_t budget = (size_t)shadow_mb << 20;
+        if (!enable_out_of_core_1(budget, path) || !enable_out_of_core_2(budget, path)) {
+            cout << "Failed to create the shadow spill file next to " << path << endl;
+            return 1;
+        }
+    }
     //double duration_1, duration_2;
 
     clock_t start, end;
@@ -72,7 +118,7 @@ int main(int argc, char* argv[]) {
         trace_file.clear();
         trace_file.seekg(0, ios::beg);
         start=clock();
-        ans1=parse_trace_1(trace_file);
+        ans1=windowed ? parse_trace_window_1(trace_file, path, from, to) : parse_trace_1(trace_file);
         for(ll i=0; i<ans1.size(); ++i){
             cout<<ans1[i]<<endl;
         }
@@ -80,6 +126,7 @@ int main(int argc, char* argv[]) {
         cout<<endl;
         double duration_1=double(end-start)/double(CLOCKS_PER_SEC);
         cout<<"DJIT algo execuiton time = "<<duration_1<<endl;
+        print_shadow_stats_1();
 
     }
     else if(algo=="fasttrack"){
@@ -87,7 +134,7 @@ int main(int argc, char* argv[]) {
         trace_file.clear();
         trace_file.seekg(0, ios::beg);
         start=clock();
-        ans2=parse_trace_2(trace_file);
+        ans2=windowed ? parse_trace_window_2(trace_file, path, from, to) : parse_trace_2(trace_file);
         for(ll i=0; i<ans2.size(); ++i){
             cout<<ans2[i]<<endl;
         }
@@ -95,6 +142,7 @@ int main(int argc, char* argv[]) {
         cout<<endl;
         double duration_1=double(end-start)/double(CLOCKS_PER_SEC);
         cout<<"FASTTRACK algo execuiton time = "<<duration_1<<endl;
+        print_shadow_stats_2();
 
         //cout<<"DJIT algo execuiton time = "<<duration_1.count()<<endl;
     }
@@ -103,27 +151,32 @@ int main(int argc, char* argv[]) {
 
 
         start=clock();
-        ans1=parse_trace_1(trace_file);
+        ans1=windowed ? parse_trace_window_1(trace_file, path, from, to) : parse_trace_1(trace_file);
         end=clock();
         double duration_1=double(end-start)/double(CLOCKS_PER_SEC);
         cout<<"DJIT algo execuiton time = "<<duration_1<<endl;
+        print_shadow_stats_1();
 
         // to reset the trace file pointer so that we have to load the file again
         trace_file.clear();
         trace_file.seekg(0, ios::beg);
 
         start=clock();
-        ans2=parse_trace_2(trace_file);
+        ans2=windowed ? parse_trace_window_2(trace_file, path, from, to) : parse_trace_2(trace_file);
         end=clock();
         double duration_2=double(end-start)/double(CLOCKS_PER_SEC);
         cout<<"FASTTRACK algo execuiton time = "<<duration_2<<endl;
+        print_shadow_stats_2();
 
         cout<<endl<<"Speedup of FASTTRACK over DJIT is = "<<(duration_1/duration_2)<<endl;
     }
     else{
         cout<<"Error! Make sure you are running a.out like this"<<endl;
         cout<<"./a.out -algo=algo_name -trace=path_to_trace_file [algo names=djit/fasttrack]"<<endl;
-        cout<<" use (-algo=all ) to print the performance gain of FASTTRACK over DJIT protocol"<<endl<<endl;
+        cout<<" use (-algo=all ) to print the performance gain of FASTTRACK over DJIT protocol"<<endl;
+        cout<<" use (-from=N -to=M) to analyze only trace lines N..M, a <trace>.<algo>.idx file is kept next to the trace"<<endl;
+        cout<<" use (-shadow_mb=MB) to keep the shadow memory under MB of RAM, cold pages are spilled to <trace>.<algo>.spill"<<endl;
+        cout<<" use (-prescreen=off) to build full shadow state also for addresses only one thread touches"<<endl<<endl;
     }
 
     return 0;
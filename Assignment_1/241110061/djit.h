@@ -6,6 +6,10 @@
 #include <sstream>
 #include <map>
 
+#include "trace_index.h"
+#include "shadow_store.h"
+#include "owner_filter.h"
+
 using namespace std;
 using ll = long long;
 
@@ -57,6 +61,19 @@ struct memory_clock_1 {
     }
 };
 
+// compact form of a memory clock for the out-of-core shadow store, only non zero entries are kept
+void shadow_save(const memory_clock_1 &m, string &out) {
+    put_sparse_vc(out, m.r_v);
+    put_sparse_vc(out, m.w_v);
+}
+void shadow_load(memory_clock_1 &m, const char *&p) {
+    get_sparse_vc(p, m.r_v);
+    get_sparse_vc(p, m.w_v);
+}
+size_t shadow_bytes(const memory_clock_1 &m) {
+    return sizeof(memory_clock_1) + (m.r_v.capacity() + m.w_v.capacity()) * sizeof(ll) + 32;
+}
+
 // Lock clock
 struct lock_clock_1 {
     vector<ll> lock;
@@ -83,176 +100,272 @@ struct lock_clock_1 {
 
 //global maps and varibnles for strcutries defined above
 unordered_map<ll, vector_clock_1> t_vc_1;                // thread_id mapped to its vector clock object
-unordered_map<unsigned long, memory_clock_1> m_vc_1;      // memoruy_addres_varaible mapped to its vector clock object
+shadow_store<memory_clock_1> m_vc_1;                      // memoruy_addres_varaible mapped to its vector clock object (can spill to disk)
 unordered_map<unsigned long, lock_clock_1> l_vc_1;        // lcok_addres mapped to its vector clock object
 unordered_map<string, ll> data_races_1;
 ll t_count_1 = 0;                                       // to keep treack of total thrads created
+unsigned long parent_tid_1 = 0, no_of_child_1 = 0;      // parent/child tracking of the parser
+bool is_parent_1 = false;
+owner_prescreen prescreen_1;                            // owner epochs of thread-local addresses
 
-// function to read the trace file and will read address in byte granularity
-// its retruning a vector of strings so that i can print the output explicitly
-vector<string> parse_trace_1(ifstream &file) {
-    string line;
-    unsigned long parent_tid, no_of_child = 0;
-    bool is_parent = false;
+// clearing all the global state so that the trace can be parsed again (index pass, windows, -algo=all)
+void reset_state_1() {
+    t_vc_1.clear();
+    m_vc_1.clear();
+    prescreen_1.clear();
+    l_vc_1.clear();
+    data_races_1.clear();
+    t_count_1 = 0;
+    parent_tid_1 = 0;
+    no_of_child_1 = 0;
+    is_parent_1 = false;
+}
 
-    while (getline(file, line)) {
-        unsigned long ip, addr;
-        unsigned long tid, is_read;
-        int size = 0;
-        ll parent = 0;
+// out-of-core mode for both the full memory clocks and the owner epochs (they get a quarter of the budget);
+// with the prescreen off the owner epochs are never used and the memory clocks get all of it
+bool enable_out_of_core_1(size_t budget, const string &path) {
+    if (!prescreen_enabled)
+        return m_vc_1.enable_spill(budget, path + ".djit.spill");
+    return m_vc_1.enable_spill(budget - budget / 4, path + ".djit.spill") &&
+           prescreen_1.owners.enable_spill(budget / 4, path + ".djit.owner.spill");
+}
 
-        //reading the address in regex format to get the required info from the line readed
-        if (sscanf(line.c_str(), "TID: %lx, IP: %lx, ADDR: %lx, Size (B): %d, isRead: %lx",  &tid, &ip, &addr, &size, &is_read) == 5)
-        {
+void print_shadow_stats_1() {
+    prescreen_1.print_stats("DJIT");
+    m_vc_1.print_stats("DJIT");
+    prescreen_1.owners.print_stats("DJIT owner");
+}
 
-            if(t_vc_1.find(tid) == t_vc_1.end()){
-                t_count_1++;
-                t_vc_1[tid].thread_clock_init_1(t_count_1);
-                for(auto &p: t_vc_1)
-                    p.second.resize_1(t_count_1);
-                for(auto &p: l_vc_1)
-                    p.second.resize_1(t_count_1);
-                for(auto &p: m_vc_1)
-                    p.second.resize_1(t_count_1);
-            }
-            // ****************************************************************************************************
+// front stage of the shadow memory: an address touched by only one thread keeps just that thread's
+// read/write clock values, no race is possible there. returns nullptr in that case, otherwise the
+// full memory clock (built from the owner's values when the second thread shows up)
+memory_clock_1 *shadow_cell_1(unsigned long a, unsigned long tid, bool is_write) {
+    auto init = [](memory_clock_1 &fresh) { fresh.m_init_1(t_count_1); };
+    if (!prescreen_enabled)
+        return &m_vc_1.get(a, init);
 
-            for (unsigned long k = 0; k < (unsigned long)size; ++k) {
+    if (prescreen_1.shared.contains(a)) {
+        if (memory_clock_1 *m = m_vc_1.find(a))
+            return m;
+        prescreen_1.false_positives++;
+    }
 
-                // if addr not already present inside the map, intialize new entry and using the object init function to manage initialization
-                if(m_vc_1.find(addr+k) == m_vc_1.end()){
-                    m_vc_1[addr+k].m_init_1(t_count_1);
-                }
+    owner_epoch &o = prescreen_1.owners[a];
+    if (o.tid == -1 || o.tid == (ll)tid) {
+        // same safety check as on the full path before using t_vc_1[tid].clock[tid]
+        if (t_vc_1[tid].clock.size() <= tid) {
+            t_vc_1[tid].resize_1(tid+1);
+        }
+        o.tid = tid;
+        (is_write ? o.write_clk : o.read_clk) = t_vc_1[tid].clock[tid];
+        prescreen_1.local_accesses++;
+        return nullptr;
+    }
 
-                if(is_read == 0){
-                    // according to djit paper, updating the particular entry of memory addr vector clock with accessing thread
-                    // entry only . i.e. only one entry is copied of tid's vector clock; not whole vector clock is copied
+    // a second thread: promoting to a full memory clock with the owner's entries filled in
+    owner_epoch owner = o;
+    prescreen_1.owners.erase(a);
+    memory_clock_1 &m = m_vc_1.get(a, init);
+    if (m.w_v.size() <= (size_t)owner.tid) {
+        m.resize_1(owner.tid+1);
+    }
+    m.w_v[owner.tid] = owner.write_clk;
+    m.r_v[owner.tid] = owner.read_clk;
+    prescreen_1.shared.add(a);
+    prescreen_1.promotions++;
+    return &m;
+}
 
-                    /* ADDED SAFETY CHECK:
-                       Before using t_vc_1[tid].clock[tid] and m_vc_1[addr+k].w_v[tid],
-                       we check that the vector sizes are large enough to avoid out-of-range indexing. */
-                    if(t_vc_1[tid].clock.size() <= tid) {
-                        t_vc_1[tid].resize_1(tid+1);
-                    }
-                    if(m_vc_1[addr+k].w_v.size() <= tid) {
-                        m_vc_1[addr+k].resize_1(tid+1);
-                    }
-                    m_vc_1[addr+k].w_v[tid] = t_vc_1[tid].clock[tid];
-
-                    // checking W-W data races
-                    for(unsigned long i = 0; i < t_count_1; ++i){
-                        if(i == tid){
-                            // skipping if same i as thread id
-                            continue;
-                        }
-                        if(m_vc_1[addr+k].w_v[i] >= t_vc_1[tid].clock[i]) {
-                            //using string stream to strei output in required format asked in assignment
-                            stringstream ss;
-                            ss << "0x" << std::hex << addr << " +" << to_string(k)
-                               << " W-W TID:" << tid << " TID:" << i << " ";
-                            data_races_1[ss.str()]++;
-                        }
-                    }
+// function to process one line of the trace, address is read in byte granularity
+// if analyze is false only the thread/lock clocks are updated and the memory clocks are not touched
+void replay_line_1(const string &line, bool analyze) {
+    unsigned long ip, addr;
+    unsigned long tid, is_read;
+    int size = 0;
 
-                    // checking W-R races
-                    for(unsigned long i = 0; i < t_count_1; ++i){
-                        if(i == tid)
-                            continue;
-                        if(m_vc_1[addr+k].r_v[i] >= t_vc_1[tid].clock[i]) {
-                            // same as R-W comments
-                            stringstream ss;
-                            ss << "0x" << std::hex << addr << " +" << to_string(k)
-                               << " R-W TID:" << tid << " TID:" << i << " ";
-                            data_races_1[ss.str()]++;
-                        }
-                    }
+    //reading the address in regex format to get the required info from the line readed
+    if (sscanf(line.c_str(), "TID: %lx, IP: %lx, ADDR: %lx, Size (B): %d, isRead: %lx",  &tid, &ip, &addr, &size, &is_read) == 5)
+    {
+
+        if(t_vc_1.find(tid) == t_vc_1.end()){
+            t_count_1++;
+            t_vc_1[tid].thread_clock_init_1(t_count_1);
+            for(auto &p: t_vc_1)
+                p.second.resize_1(t_count_1);
+            for(auto &p: l_vc_1)
+                p.second.resize_1(t_count_1);
+            m_vc_1.for_each_resident([](memory_clock_1 &m) { m.resize_1(t_count_1); });
+        }
+        // ****************************************************************************************************
+
+        // sync-only replay (index building / seeking to a window) stops here
+        if(!analyze)
+            return;
+
+        for (unsigned long k = 0; k < (unsigned long)size; ++k) {
+
+            // if addr not already present inside the map, intialize new entry (or only the owner epoch if thread-local)
+            memory_clock_1 *mp = shadow_cell_1(addr+k, tid, is_read == 0);
+            if (!mp)
+                continue;
+            memory_clock_1 &m = *mp;
+            // a page that was spilled to disk missed the resizes done while it was out of memory
+            m.resize_1(t_count_1);
+
+            if(is_read == 0){
+                // according to djit paper, updating the particular entry of memory addr vector clock with accessing thread
+                // entry only . i.e. only one entry is copied of tid's vector clock; not whole vector clock is copied
+
+                /* ADDED SAFETY CHECK:
+                   Before using t_vc_1[tid].clock[tid] and m.w_v[tid],
+                   we check that the vector sizes are large enough to avoid out-of-range indexing. */
+                if(t_vc_1[tid].clock.size() <= tid) {
+                    t_vc_1[tid].resize_1(tid+1);
                 }
-                // if memory access is read access
-                else {
-                    /* ADDED SAFETY CHECK:
-                       Before using t_vc_1[tid].clock[tid] and m_vc_1[addr+k].r_v[tid],
-                       we check that the vector sizes are large enough. */
-                    if(t_vc_1[tid].clock.size() <= tid) {
-                        t_vc_1[tid].resize_1(tid+1);
-                    }
-                    if(m_vc_1[addr+k].r_v.size() <= tid) {
-                        m_vc_1[addr+k].resize_1(tid+1);
+                if(m.w_v.size() <= tid) {
+                    m.resize_1(tid+1);
+                }
+                m.w_v[tid] = t_vc_1[tid].clock[tid];
+
+                // checking W-W data races
+                for(unsigned long i = 0; i < t_count_1; ++i){
+                    if(i == tid){
+                        // skipping if same i as thread id
+                        continue;
                     }
-                    m_vc_1[addr+k].r_v[tid] = t_vc_1[tid].clock[tid];
-
-                    // checking R-W races [ R is currect access and W is older ]
-                    for(unsigned long i = 0; i < t_count_1; ++i){
-                        if(i == tid)
-                            continue;
-                        if(m_vc_1[addr+k].w_v[i] >= t_vc_1[tid].clock[i]) {
-                            // same as W-W comment
-                            stringstream ss;
-                            ss << "0x" << std::hex << addr << " +" << to_string(k)
-                               << " W-R TID:" << tid << " TID:" << i << " ";
-                            data_races_1[ss.str()]++;
-                        }
+                    if(m.w_v[i] >= t_vc_1[tid].clock[i]) {
+                        //using string stream to strei output in required format asked in assignment
+                        stringstream ss;
+                        ss << "0x" << std::hex << addr << " +" << to_string(k)
+                           << " W-W TID:" << tid << " TID:" << i << " ";
+                        data_races_1[ss.str()]++;
                     }
                 }
-            }
-        }
-        else {
-            // THis means new thread has been created therefore will
-            // 1. init new thread vector clocks
-            // 2. resize older tjhread vector clocks
-            // 3. resize all read, write and locks vector clocks witn new index as that of this thread's id
-            if (sscanf(line.c_str(), "Thread begin: %lx", &tid) == 1) {
-                t_count_1++;
-
-                if(t_vc_1.find(tid) == t_vc_1.end()){
-                    t_vc_1[tid].thread_clock_init_1(t_count_1);
-                }
 
-                for(auto &p: t_vc_1){
-                    p.second.resize_1(t_count_1);
+                // checking W-R races
+                for(unsigned long i = 0; i < t_count_1; ++i){
+                    if(i == tid)
+                        continue;
+                    if(m.r_v[i] >= t_vc_1[tid].clock[i]) {
+                        // same as R-W comments
+                        stringstream ss;
+                        ss << "0x" << std::hex << addr << " +" << to_string(k)
+                           << " R-W TID:" << tid << " TID:" << i << " ";
+                        data_races_1[ss.str()]++;
+                    }
                 }
-                for(auto &p: l_vc_1){
-                    p.second.resize_1(t_count_1);
+            }
+            // if memory access is read access
+            else {
+                /* ADDED SAFETY CHECK:
+                   Before using t_vc_1[tid].clock[tid] and m.r_v[tid],
+                   we check that the vector sizes are large enough. */
+                if(t_vc_1[tid].clock.size() <= tid) {
+                    t_vc_1[tid].resize_1(tid+1);
                 }
-                for(auto &p: m_vc_1){
-                    p.second.resize_1(t_count_1);
+                if(m.r_v.size() <= tid) {
+                    m.resize_1(tid+1);
                 }
-                // if current thread is child of any paratn threqad then copying the vector clock of parent into child thread
-                if(no_of_child > 0){
-                    t_vc_1[tid] = t_vc_1[parent_tid];
+                m.r_v[tid] = t_vc_1[tid].clock[tid];
+
+                // checking R-W races [ R is currect access and W is older ]
+                for(unsigned long i = 0; i < t_count_1; ++i){
+                    if(i == tid)
+                        continue;
+                    if(m.w_v[i] >= t_vc_1[tid].clock[i]) {
+                        // same as W-W comment
+                        stringstream ss;
+                        ss << "0x" << std::hex << addr << " +" << to_string(k)
+                           << " W-R TID:" << tid << " TID:" << i << " ";
+                        data_races_1[ss.str()]++;
+                    }
                 }
             }
-            else if (sscanf(line.c_str(), "Before pthread_create(): Parent: %lx", &parent_tid) == 1) {
-                // here i am tracking the praetns in case of fork join and othter parent and child thread relation
-                is_parent = true;
-                no_of_child++;
+        }
+    }
+    else {
+        // THis means new thread has been created therefore will
+        // 1. init new thread vector clocks
+        // 2. resize older tjhread vector clocks
+        // 3. resize all read, write and locks vector clocks witn new index as that of this thread's id
+        if (sscanf(line.c_str(), "Thread begin: %lx", &tid) == 1) {
+            t_count_1++;
+
+            if(t_vc_1.find(tid) == t_vc_1.end()){
+                t_vc_1[tid].thread_clock_init_1(t_count_1);
             }
-            else if (sscanf(line.c_str(), "After lock acquire: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
-                // if no entry of lock address in map , init the new entry
-                if (l_vc_1.find(addr) == l_vc_1.end()) {
-                    l_vc_1[addr].lock_init_1(t_count_1);
-                }
-                /// updating the current tid thread 's vector clocsk with max of locks and current thread vector clock
-                t_vc_1[tid].update_1_lock_1(l_vc_1[addr].lock);
+
+            for(auto &p: t_vc_1){
+                p.second.resize_1(t_count_1);
             }
-            else if (sscanf(line.c_str(), "After lock release: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
-                // increementing the therad vector clocks value
-                //
-                t_vc_1[tid].inc_1(tid);
-                // after increamenting updating the locks vector clcjwith nax of therad and locks vector clock
-                l_vc_1[addr].update_1(t_vc_1[tid]);
+            for(auto &p: l_vc_1){
+                p.second.resize_1(t_count_1);
             }
-            else if (sscanf(line.c_str(), "Thread ended: %lx", &tid) == 1) {
-                // tracking the whihc thread ended if child ended then decremnign the no of child crreonoposndinly
-                if(is_parent){
-                    no_of_child--;
-                    if(no_of_child == 0){
-                        is_parent = false;
-                    }
+            m_vc_1.for_each_resident([](memory_clock_1 &m) { m.resize_1(t_count_1); });
+            // if current thread is child of any paratn threqad then copying the vector clock of parent into child thread
+            if(no_of_child_1 > 0){
+                t_vc_1[tid] = t_vc_1[parent_tid_1];
+            }
+        }
+        else if (sscanf(line.c_str(), "Before pthread_create(): Parent: %lx", &parent_tid_1) == 1) {
+            // here i am tracking the praetns in case of fork join and othter parent and child thread relation
+            is_parent_1 = true;
+            no_of_child_1++;
+        }
+        else if (sscanf(line.c_str(), "After lock acquire: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
+            // if no entry of lock address in map , init the new entry
+            if (l_vc_1.find(addr) == l_vc_1.end()) {
+                l_vc_1[addr].lock_init_1(t_count_1);
+            }
+            /// updating the current tid thread 's vector clocsk with max of locks and current thread vector clock
+            t_vc_1[tid].update_1_lock_1(l_vc_1[addr].lock);
+        }
+        else if (sscanf(line.c_str(), "After lock release: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
+            // increementing the therad vector clocks value
+            //
+            t_vc_1[tid].inc_1(tid);
+            // after increamenting updating the locks vector clcjwith nax of therad and locks vector clock
+            l_vc_1[addr].update_1(t_vc_1[tid]);
+        }
+        else if (sscanf(line.c_str(), "Thread ended: %lx", &tid) == 1) {
+            // tracking the whihc thread ended if child ended then decremnign the no of child crreonoposndinly
+            if(is_parent_1){
+                no_of_child_1--;
+                if(no_of_child_1 == 0){
+                    is_parent_1 = false;
                 }
             }
         }
     }
-    // this is to store all the races string in vector and then finally returning the vector to print explictly when needed
+}
+
+// copying the thread and lock vector clocks into an index snapshot
+void capture_1(trace_snapshot &s) {
+    s.t_count = t_count_1;
+    s.parent_tid = parent_tid_1;
+    s.no_of_child = no_of_child_1;
+    s.is_parent = is_parent_1;
+    for(auto &p: t_vc_1)
+        s.threads[p.first] = p.second.clock;
+    for(auto &p: l_vc_1)
+        s.locks[p.first] = p.second.lock;
+}
+
+// starting again from a snapshot, memory clocks are empty after this
+void restore_1(const trace_snapshot &s) {
+    reset_state_1();
+    t_count_1 = s.t_count;
+    parent_tid_1 = s.parent_tid;
+    no_of_child_1 = s.no_of_child;
+    is_parent_1 = s.is_parent;
+    for(auto &p: s.threads)
+        t_vc_1[p.first].clock = p.second;
+    for(auto &p: s.locks)
+        l_vc_1[p.first].lock = p.second;
+}
+
+// this is to store all the races string in vector and then finally returning the vector to print explictly when needed
+vector<string> collect_races_1() {
     vector<string> records;
     // Print final data races
     for(auto &p : data_races_1){
@@ -262,3 +375,42 @@ vector<string> parse_trace_1(ifstream &file) {
     return records;
 }
 
+// function to read the trace file and will read address in byte granularity
+// its retruning a vector of strings so that i can print the output explicitly
+vector<string> parse_trace_1(ifstream &file) {
+    string line;
+    reset_state_1();
+    while (getline(file, line)) {
+        replay_line_1(line, true);
+    }
+    return collect_races_1();
+}
+
+// only analyzing lines [from, to] (1 based, to = 0 means till the end of trace)
+// the index gives the nearest snapshot before 'from', only the lines after it are replayed
+vector<string> parse_trace_window_1(ifstream &file, const string &path, ll from, ll to) {
+    trace_index idx = load_or_build_index(file, path, "djit",
+        [](const string &line) { replay_line_1(line, false); },
+        [](trace_snapshot &s) { capture_1(s); });
+
+    const trace_snapshot *snap = idx.nearest(from > 0 ? from - 1 : 0);
+    ll line_no = 0;
+    file.clear();
+    if (snap) {
+        restore_1(*snap);
+        line_no = snap->line;
+        file.seekg(snap->offset, ios::beg);
+    } else {
+        reset_state_1();
+        file.seekg(0, ios::beg);
+    }
+
+    string line;
+    while (getline(file, line)) {
+        line_no++;
+        if (to > 0 && line_no > to)
+            break;
+        replay_line_1(line, line_no >= from);
+    }
+    return collect_races_1();
+}
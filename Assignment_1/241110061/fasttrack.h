@@ -6,6 +6,10 @@
 #include <sstream>
 #include <map>
 
+#include "trace_index.h"
+#include "shadow_store.h"
+#include "owner_filter.h"
+
 using namespace std;
 using ll = long long;
 
@@ -78,6 +82,31 @@ struct memory_clock {
     }
 };
 
+// 
+// Compact form of a memory clock for the out-of-core shadow store (varints, sparse readVC).
+// 
+void shadow_save(const memory_clock &m, string &out) {
+    put_svarint(out, m.writeTid);
+    put_svarint(out, m.writeClockVal);
+    put_varint(out, m.read_shared);
+    put_svarint(out, m.readTid);
+    put_svarint(out, m.readClockVal);
+    put_sparse_vc(out, m.readVC);
+}
+
+void shadow_load(memory_clock &m, const char *&p) {
+    m.writeTid      = get_svarint(p);
+    m.writeClockVal = get_svarint(p);
+    m.read_shared   = get_varint(p) != 0;
+    m.readTid       = get_svarint(p);
+    m.readClockVal  = get_svarint(p);
+    get_sparse_vc(p, m.readVC);
+}
+
+size_t shadow_bytes(const memory_clock &m) {
+    return sizeof(memory_clock) + m.readVC.capacity() * sizeof(ll) + 32;
+}
+
 // 
 // This struct represents the lock clock.
 // It keeps the latest vector clock of the thread that released the lock.
@@ -113,10 +142,14 @@ struct lock_clock {
 // Also, a map to store detected data races, and a global thread count (t_count).
 // 
 unordered_map<ll, vector_clock> t_vc;          // TID -> vector_clock
-unordered_map<unsigned long, memory_clock> m_vc; // address -> memory_clock
+shadow_store<memory_clock> m_vc;                 // address -> memory_clock (can spill to disk)
 unordered_map<unsigned long, lock_clock> l_vc;   // lockAddr -> lock_clock
 unordered_map<string, ll> data_races;            // Map for storing race descriptions and counts
 ll t_count = 0;                                  // Total number of threads created
+unsigned long parent_tid_2 = 0;                  // Parent/child tracking state of the parser
+unsigned long no_of_child_2 = 0;
+bool is_parent_2 = false;
+owner_prescreen prescreen_2;                     // Owner epochs of thread-local addresses
 
 // 
 // Returns the current "epoch" (clock value) of the given thread (indexed by tid).
@@ -240,100 +273,209 @@ void fasttrack_write(unsigned long baseAddr, unsigned long offset, memory_clock
 }
 
 // 
-// parse_trace_2: Reads the trace file line by line, parses the events,
-// updates thread/memory/lock vector clocks, and detects data races.
+// reset_state_2: Clears all global state so that the trace can be parsed again
+// (index pass, windowed analysis, -algo=all).
 // 
-vector<string> parse_trace_2(ifstream &file) {
-    string line;
-    unsigned long parent_tid, no_of_child = 0;
-    bool is_parent = false;
+void reset_state_2() {
+    t_vc.clear();
+    m_vc.clear();
+    prescreen_2.clear();
+    l_vc.clear();
+    data_races.clear();
+    t_count = 0;
+    parent_tid_2 = 0;
+    no_of_child_2 = 0;
+    is_parent_2 = false;
+}
 
-    while (getline(file, line)) {
-        unsigned long ip, addr;
-        unsigned long tid, is_read;
-        int size = 0;
+// 
+// enable_out_of_core_2: Spills both the memory clocks and the owner epochs (a quarter of the budget).
+// With the prescreen off the owner epochs are never used, so the memory clocks get the whole budget.
+// 
+bool enable_out_of_core_2(size_t budget, const string &path) {
+    if (!prescreen_enabled)
+        return m_vc.enable_spill(budget, path + ".fasttrack.spill");
+    return m_vc.enable_spill(budget - budget / 4, path + ".fasttrack.spill") &&
+           prescreen_2.owners.enable_spill(budget / 4, path + ".fasttrack.owner.spill");
+}
+
+void print_shadow_stats_2() {
+    prescreen_2.print_stats("FASTTRACK");
+    m_vc.print_stats("FASTTRACK");
+    prescreen_2.owners.print_stats("FASTTRACK owner");
+}
 
-        // If the line matches a memory access event
-        if (sscanf(line.c_str(),"TID: %lx, IP: %lx, ADDR: %lx, Size (B): %d, isRead: %lx",&tid, &ip, &addr, &size, &is_read) == 5)
-        {
+// 
+// sharedCellOf: Front stage of the shadow memory. While only one thread touches an address we keep
+// just its last write/read epoch, no race is possible and no memory_clock (with its readVC) is built.
+// Returns nullptr in that case, otherwise the full memory clock, created from the owner's epochs
+// when a second thread shows up.
+// 
+memory_clock *sharedCellOf(unsigned long subaddr, ll tid, bool isWrite)
+{
+    auto init = [](memory_clock &fresh) { fresh.m_init(t_count); };
+    if (!prescreen_enabled)
+        return &m_vc.get(subaddr, init);
+
+    if (prescreen_2.shared.contains(subaddr)) {
+        if (memory_clock *m = m_vc.find(subaddr))
+            return m;
+        prescreen_2.false_positives++;
+    }
 
-            if(t_vc.find(tid) == t_vc.end()){
-                t_count++;
-                t_vc[tid].thread_clock_init(t_count);
-                for(auto &p: t_vc)
-                    p.second.resize(t_count);
-                for(auto &p: l_vc)
-                    p.second.resize(t_count);
-                for(auto &p: m_vc)
-                    p.second.resize(t_count);
-            }
-            // ***************************************************************************
-
-            // Process each byte (subaddress) in the memory access
-            for (int k = 0; k < size; ++k) {
-                unsigned long subaddr = addr + k;
-                // Initialize the memory clock for this address if not already done
-                if (m_vc.find(subaddr) == m_vc.end()) {
-                    m_vc[subaddr] = memory_clock();
-                    m_vc[subaddr].m_init(t_count);
-                }
-                // For write access, call fasttrack_write; otherwise, fasttrack_read
-                if (is_read == 0) {
-                    fasttrack_write(addr, k, m_vc[subaddr], tid);
-                } else {
-                    fasttrack_read(addr, k, m_vc[subaddr], tid);
-                }
+    owner_epoch &o = prescreen_2.owners[subaddr];
+    if (o.tid == -1 || o.tid == tid) {
+        ll curEpoch = currentEpochOf(tid);
+        o.tid = tid;
+        if (isWrite) {
+            // Same as fasttrack_write: the write resets the read epoch
+            o.write_clk = curEpoch;
+            o.read_clk = 0;
+        } else {
+            o.read_clk = max(o.read_clk, curEpoch);
+        }
+        prescreen_2.local_accesses++;
+        return nullptr;
+    }
+
+    // Second thread: promote to a full memory clock holding the owner's epochs
+    owner_epoch owner = o;
+    prescreen_2.owners.erase(subaddr);
+    memory_clock &m = m_vc.get(subaddr, init);
+    if (owner.write_clk > 0) {
+        m.writeTid = owner.tid;
+        m.writeClockVal = owner.write_clk;
+    }
+    if (owner.read_clk > 0) {
+        m.readTid = owner.tid;
+        m.readClockVal = owner.read_clk;
+    }
+    prescreen_2.shared.add(subaddr);
+    prescreen_2.promotions++;
+    return &m;
+}
+
+// 
+// replay_line_2: Parses one event of the trace and updates thread/memory/lock vector clocks.
+// If analyze is false only the thread and lock clocks are updated (no race checks).
+// 
+void replay_line_2(const string &line, bool analyze) {
+    unsigned long ip, addr;
+    unsigned long tid, is_read;
+    int size = 0;
+
+    // If the line matches a memory access event
+    if (sscanf(line.c_str(),"TID: %lx, IP: %lx, ADDR: %lx, Size (B): %d, isRead: %lx",&tid, &ip, &addr, &size, &is_read) == 5)
+    {
+
+        if(t_vc.find(tid) == t_vc.end()){
+            t_count++;
+            t_vc[tid].thread_clock_init(t_count);
+            for(auto &p: t_vc)
+                p.second.resize(t_count);
+            for(auto &p: l_vc)
+                p.second.resize(t_count);
+            m_vc.for_each_resident([](memory_clock &m) { m.resize(t_count); });
+        }
+        // ***************************************************************************
+
+        // Sync-only replay (index building / seeking to a window) stops here
+        if (!analyze)
+            return;
+
+        // Process each byte (subaddress) in the memory access
+        for (int k = 0; k < size; ++k) {
+            unsigned long subaddr = addr + k;
+            // Initialize the memory clock for this address if not already done (only the owner epoch while thread-local)
+            memory_clock *mp = sharedCellOf(subaddr, tid, is_read == 0);
+            if (!mp)
+                continue;
+            memory_clock &m = *mp;
+            // A page that was spilled to disk missed the resizes done while it was out of memory
+            m.resize(t_count);
+            // For write access, call fasttrack_write; otherwise, fasttrack_read
+            if (is_read == 0) {
+                fasttrack_write(addr, k, m, tid);
+            } else {
+                fasttrack_read(addr, k, m, tid);
             }
         }
-        else {
-            // Else, process thread and lock events
-            if (sscanf(line.c_str(), "Thread begin: %lx", &tid) == 1) {
-                t_count++;
-                if (t_vc.find(tid) == t_vc.end()) {
-                    t_vc[tid].thread_clock_init(t_count);
-                }
-                // Resize all vector clocks for newly added thread slot
-                for (auto &p: t_vc) {
-                    p.second.resize(t_count);
-                }
-                for (auto &p: l_vc) {
-                    p.second.resize(t_count);
-                }
-                for (auto &p: m_vc) {
-                    p.second.resize(t_count);
-                }
+    }
+    else {
+        // Else, process thread and lock events
+        if (sscanf(line.c_str(), "Thread begin: %lx", &tid) == 1) {
+            t_count++;
+            if (t_vc.find(tid) == t_vc.end()) {
+                t_vc[tid].thread_clock_init(t_count);
             }
-            else if (sscanf(line.c_str(), "Before pthread_create(): Parent: %lx", &parent_tid) == 1) {
-                is_parent = true;
-                no_of_child++;
+            // Resize all vector clocks for newly added thread slot
+            for (auto &p: t_vc) {
+                p.second.resize(t_count);
             }
-            else if (sscanf(line.c_str(), "After lock acquire: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
-                // Initialize lock clock if not already done
-                if (l_vc.find(addr) == l_vc.end()) {
-                    l_vc[addr].lock_init(t_count);
-                }
-                // Update the thread's vector clock with the lock's vector clock
-                t_vc[tid].update_lock(l_vc[addr].lock);
+            for (auto &p: l_vc) {
+                p.second.resize(t_count);
             }
-            else if (sscanf(line.c_str(), "After lock release: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
-                // Increment the thread's clock after releasing the lock
-                t_vc[tid].inc(tid);
-                // Update the lock clock with the thread's vector clock after release
-                l_vc[addr].update(t_vc[tid]);
+            m_vc.for_each_resident([](memory_clock &m) { m.resize(t_count); });
+        }
+        else if (sscanf(line.c_str(), "Before pthread_create(): Parent: %lx", &parent_tid_2) == 1) {
+            is_parent_2 = true;
+            no_of_child_2++;
+        }
+        else if (sscanf(line.c_str(), "After lock acquire: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
+            // Initialize lock clock if not already done
+            if (l_vc.find(addr) == l_vc.end()) {
+                l_vc[addr].lock_init(t_count);
             }
-            else if (sscanf(line.c_str(), "Thread ended: %lx", &tid) == 1) {
-                // If thread ended and is a child thread, update the child count accordingly
-                if (is_parent) {
-                    no_of_child--;
-                    if (no_of_child == 0) {
-                        is_parent = false;
-                    }
+            // Update the thread's vector clock with the lock's vector clock
+            t_vc[tid].update_lock(l_vc[addr].lock);
+        }
+        else if (sscanf(line.c_str(), "After lock release: TID: %lx, Lock address: %lx", &tid, &addr) == 2) {
+            // Increment the thread's clock after releasing the lock
+            t_vc[tid].inc(tid);
+            // Update the lock clock with the thread's vector clock after release
+            l_vc[addr].update(t_vc[tid]);
+        }
+        else if (sscanf(line.c_str(), "Thread ended: %lx", &tid) == 1) {
+            // If thread ended and is a child thread, update the child count accordingly
+            if (is_parent_2) {
+                no_of_child_2--;
+                if (no_of_child_2 == 0) {
+                    is_parent_2 = false;
                 }
             }
         }
     }
+}
+
+// 
+// capture_2 / restore_2: Copy the thread and lock clocks into an index snapshot and back.
+// After a restore the memory clocks are empty.
+// 
+void capture_2(trace_snapshot &s) {
+    s.t_count = t_count;
+    s.parent_tid = parent_tid_2;
+    s.no_of_child = no_of_child_2;
+    s.is_parent = is_parent_2;
+    for (auto &p: t_vc)
+        s.threads[p.first] = p.second.clock;
+    for (auto &p: l_vc)
+        s.locks[p.first] = p.second.lock;
+}
+
+void restore_2(const trace_snapshot &s) {
+    reset_state_2();
+    t_count = s.t_count;
+    parent_tid_2 = s.parent_tid;
+    no_of_child_2 = s.no_of_child;
+    is_parent_2 = s.is_parent;
+    for (auto &p: s.threads)
+        t_vc[p.first].clock = p.second;
+    for (auto &p: s.locks)
+        l_vc[p.first].lock = p.second;
+}
 
-    // Collect all race reports into a vector of strings for final output.
+// Collect all race reports into a vector of strings for final output.
+vector<string> collect_races_2() {
     vector<string> records;
     for (auto &p: data_races) {
         records.push_back(p.first + to_string(p.second));
@@ -341,3 +483,46 @@ vector<string> parse_trace_2(ifstream &file) {
     return records;
 }
 
+// 
+// parse_trace_2: Reads the trace file line by line, parses the events,
+// updates thread/memory/lock vector clocks, and detects data races.
+// 
+vector<string> parse_trace_2(ifstream &file) {
+    string line;
+    reset_state_2();
+    while (getline(file, line)) {
+        replay_line_2(line, true);
+    }
+    return collect_races_2();
+}
+
+// 
+// parse_trace_window_2: Analyzes only lines [from, to] (1 based, to = 0 means till the end).
+// Seeks to the nearest index snapshot before 'from' and replays only the sync events up to it.
+// 
+vector<string> parse_trace_window_2(ifstream &file, const string &path, ll from, ll to) {
+    trace_index idx = load_or_build_index(file, path, "fasttrack",
+        [](const string &line) { replay_line_2(line, false); },
+        [](trace_snapshot &s) { capture_2(s); });
+
+    const trace_snapshot *snap = idx.nearest(from > 0 ? from - 1 : 0);
+    ll line_no = 0;
+    file.clear();
+    if (snap) {
+        restore_2(*snap);
+        line_no = snap->line;
+        file.seekg(snap->offset, ios::beg);
+    } else {
+        reset_state_2();
+        file.seekg(0, ios::beg);
+    }
+
+    string line;
+    while (getline(file, line)) {
+        line_no++;
+        if (to > 0 && line_no > to)
+            break;
+        replay_line_2(line, line_no >= from);
+    }
+    return collect_races_2();
+}
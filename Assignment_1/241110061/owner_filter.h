@@ -0,0 +1,128 @@
+#ifndef OWNER_FILTER_H
+#define OWNER_FILTER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+#include "shadow_store.h"
+
+using namespace std;
+using ll = long long;
+
+// size of the bloom filter of shared addresses (bits) and number of hash functions
+#define SHARED_FILTER_BITS (1UL << 24)
+#define SHARED_FILTER_HASHES 3
+
+// the pre-screen can be turned off (-prescreen=off) to compare against full shadow state everywhere
+bool prescreen_enabled = true;
+
+//
+// Shadow state of an address touched by a single thread so far. Only the epochs of that thread
+// are needed: without a second thread there can be no race, and when a second thread comes the
+// full memory clock is built from these values.
+//
+struct owner_epoch {
+    ll tid = -1;        // the owning thread, -1 = never touched
+    ll write_clk = 0;   // owner's clock at its last write, 0 = no write (thread clocks start at 1)
+    ll read_clk = 0;    // owner's clock at its last read, 0 = no read
+};
+
+void shadow_save(const owner_epoch &o, string &out) {
+    put_svarint(out, o.tid);
+    put_svarint(out, o.write_clk);
+    put_svarint(out, o.read_clk);
+}
+
+void shadow_load(owner_epoch &o, const char *&p) {
+    o.tid = get_svarint(p);
+    o.write_clk = get_svarint(p);
+    o.read_clk = get_svarint(p);
+}
+
+size_t shadow_bytes(const owner_epoch &) {
+    return sizeof(owner_epoch) + 32;
+}
+
+//
+// Bloom filter over the addresses that have been promoted to full shadow state, after the
+// ConcurrentBloomFilter of Assignment 2 (problem 3). The detectors are single threaded so plain
+// bits are enough. A negative answer means the address is surely still thread-local and the full
+// shadow map does not have to be searched at all.
+//
+class shared_addr_filter {
+public:
+    shared_addr_filter(size_t filterSize = SHARED_FILTER_BITS, int numHashFunctions = SHARED_FILTER_HASHES)
+        : filterSize(filterSize), numHashFunctions(numHashFunctions), bloomBits((filterSize + 63) / 64, 0) {}
+
+    void add(unsigned long addr) {
+        uint64_t h = mix(addr);
+        for (int i = 0; i < numHashFunctions; ++i) {
+            size_t pos = computeHash(h, i);
+            bloomBits[pos / 64] |= 1ULL << (pos % 64);
+        }
+    }
+
+    bool contains(unsigned long addr) const {
+        uint64_t h = mix(addr);
+        for (int i = 0; i < numHashFunctions; ++i) {
+            size_t pos = computeHash(h, i);
+            if (!(bloomBits[pos / 64] & (1ULL << (pos % 64))))
+                return false;
+        }
+        return true;
+    }
+
+    void clear() {
+        fill(bloomBits.begin(), bloomBits.end(), 0);
+    }
+
+private:
+    size_t filterSize;
+    int numHashFunctions;
+    vector<uint64_t> bloomBits;
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // double hashing: the i-th position is h1 + i * h2
+    size_t computeHash(uint64_t h, int seedValue) const {
+        uint64_t h1 = h & 0xffffffffULL, h2 = (h >> 32) | 1;
+        return (h1 + (uint64_t)seedValue * h2) % filterSize;
+    }
+};
+
+//
+// Front stage of a detector: owner epochs of thread-local addresses, the bloom filter of
+// promoted (shared) addresses and counters of how many accesses each path took.
+//
+struct owner_prescreen {
+    shadow_store<owner_epoch> owners;
+    shared_addr_filter shared;
+    ll local_accesses = 0;   // handled with the owner epoch only
+    ll promotions = 0;       // addresses that got a second thread and full shadow state
+    ll false_positives = 0;  // filter said shared but the address was still thread-local
+
+    void clear() {
+        owners.clear();
+        shared.clear();
+        local_accesses = promotions = false_positives = 0;
+    }
+
+    void print_stats(const string &name) const {
+        if (!prescreen_enabled)
+            return;
+        cout << name << " thread-local accesses = " << local_accesses << ", promoted addresses = " << promotions
+             << ", filter false positives = " << false_positives << endl;
+    }
+};
+
+#endif
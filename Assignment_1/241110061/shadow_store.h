@@ -0,0 +1,330 @@
+#ifndef SHADOW_STORE_H
+#define SHADOW_STORE_H
+
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <list>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+using ll = long long;
+
+// addresses sharing the upper bits belong to one shadow page, pages are the unit of spilling
+#define SHADOW_PAGE_BITS 6
+
+//
+// Varint helpers for the compact on-disk form of the memory clocks.
+// Signed values (thread ids can be -1) go through zigzag encoding first.
+//
+inline void put_varint(string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+inline uint64_t get_varint(const char *&p) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (true) {
+        uint8_t b = (uint8_t)*p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (b < 0x80)
+            break;
+        shift += 7;
+    }
+    return v;
+}
+
+inline void put_svarint(string &out, ll v) {
+    put_varint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+inline ll get_svarint(const char *&p) {
+    uint64_t v = get_varint(p);
+    return (ll)(v >> 1) ^ -(ll)(v & 1);
+}
+
+// only the non zero entries of a vector clock are written, as (index, value) pairs
+inline void put_sparse_vc(string &out, const vector<ll> &vc) {
+    size_t nz = 0;
+    for (ll v : vc)
+        nz += (v != 0);
+    put_varint(out, vc.size());
+    put_varint(out, nz);
+    for (size_t i = 0; i < vc.size(); ++i) {
+        if (vc[i] != 0) {
+            put_varint(out, i);
+            put_svarint(out, vc[i]);
+        }
+    }
+}
+
+inline void get_sparse_vc(const char *&p, vector<ll> &vc) {
+    vc.assign(get_varint(p), 0);
+    size_t nz = get_varint(p);
+    for (size_t j = 0; j < nz; ++j) {
+        size_t i = get_varint(p);
+        vc[i] = get_svarint(p);
+    }
+}
+
+//
+// Shadow memory of a detector: address -> T (memory clock).
+// By default it behaves like an unordered_map. With enable_spill() the resident pages are kept
+// under a memory budget: the least recently used page is written to a local spill file and read
+// back (faulted in) on its next access. T must provide the free functions
+//   shadow_save(const T&, string&), shadow_load(T&, const char*&), shadow_bytes(const T&)
+//
+template <class T>
+class shadow_store {
+private:
+    struct page {
+        unordered_map<unsigned long, T> cells;
+        list<unsigned long>::iterator lru_pos;
+        size_t bytes = 0;                       // approximate RAM used by the cells of this page
+    };
+    struct spill_slot {
+        long long offset;
+        size_t capacity;                        // bytes reserved in the file for this page
+        size_t len;
+    };
+
+    unordered_map<unsigned long, page> resident;
+    unordered_map<unsigned long, spill_slot> spilled;
+    list<unsigned long> lru;                    // front = most recently used page
+
+    // the last page touched, consecutive bytes of one access nearly always share it
+    unsigned long last_no = 0;
+    page *last = nullptr;
+
+    size_t budget = 0;                          // 0 = everything stays in memory
+    size_t resident_bytes = 0;
+    string spill_path;
+    FILE *spill = nullptr;
+    long long spill_end = 0;
+    string buf;
+
+public:
+    // traffic counters of the out-of-core mode
+    ll pages_spilled = 0, bytes_spilled = 0;
+    ll pages_reloaded = 0, bytes_reloaded = 0;
+
+    shadow_store() {}
+    shadow_store(const shadow_store &) = delete;
+    shadow_store &operator=(const shadow_store &) = delete;
+
+    ~shadow_store() {
+        close_spill();
+    }
+
+    // turn on the out-of-core mode, budget_bytes is the RAM allowed for resident pages
+    bool enable_spill(size_t budget_bytes, const string &path) {
+        close_spill();
+        spill = fopen(path.c_str(), "w+b");
+        if (!spill)
+            return false;
+        spill_path = path;
+        budget = budget_bytes;
+        return true;
+    }
+
+    bool out_of_core() const {
+        return spill != nullptr;
+    }
+
+    // number of cells currently in memory
+    size_t size() const {
+        size_t n = 0;
+        for (auto &p : resident)
+            n += p.second.cells.size();
+        return n;
+    }
+
+    // pointer to the shadow cell of addr or nullptr if it never was created
+    T *find(unsigned long addr) {
+        page *pg = get_page(addr >> SHADOW_PAGE_BITS, false);
+        if (!pg)
+            return nullptr;
+        auto it = pg->cells.find(addr);
+        return it == pg->cells.end() ? nullptr : &it->second;
+    }
+
+    // shadow cell of addr, created and passed to init() if missing.
+    // The reference stays valid until the next call into the store.
+    template <class F>
+    T &get(unsigned long addr, F init) {
+        unsigned long no = addr >> SHADOW_PAGE_BITS;
+        page *pg = get_page(no, true);
+        auto res = pg->cells.try_emplace(addr);
+        if (res.second) {
+            init(res.first->second);
+            if (budget) {
+                size_t b = shadow_bytes(res.first->second);
+                pg->bytes += b;
+                resident_bytes += b;
+                evict_over_budget(no);
+            }
+        }
+        return res.first->second;
+    }
+
+    T &operator[](unsigned long addr) {
+        return get(addr, [](T &) {});
+    }
+
+    // drop the cell of addr, returns false if there was none
+    bool erase(unsigned long addr) {
+        page *pg = get_page(addr >> SHADOW_PAGE_BITS, false);
+        if (!pg)
+            return false;
+        auto it = pg->cells.find(addr);
+        if (it == pg->cells.end())
+            return false;
+        if (budget) {
+            size_t b = min(pg->bytes, shadow_bytes(it->second));
+            pg->bytes -= b;
+            resident_bytes -= min(resident_bytes, b);
+        }
+        pg->cells.erase(it);
+        return true;
+    }
+
+    // visit the cells that are currently in memory, spilled pages are not faulted in
+    template <class F>
+    void for_each_resident(F fn) {
+        for (auto &p : resident)
+            for (auto &c : p.second.cells)
+                fn(c.second);
+    }
+
+    void clear() {
+        resident.clear();
+        spilled.clear();
+        lru.clear();
+        last = nullptr;
+        resident_bytes = 0;
+        spill_end = 0;
+        pages_spilled = bytes_spilled = pages_reloaded = bytes_reloaded = 0;
+    }
+
+    void print_stats(const string &name) const {
+        if (!spill)
+            return;
+        cout << name << " shadow pages spilled = " << pages_spilled << " (" << bytes_spilled << " B), reloaded = "
+             << pages_reloaded << " (" << bytes_reloaded << " B), spill file = " << spill_end << " B" << endl;
+    }
+
+private:
+    void close_spill() {
+        if (spill) {
+            fclose(spill);
+            remove(spill_path.c_str());
+            spill = nullptr;
+        }
+    }
+
+    page *get_page(unsigned long no, bool create) {
+        if (last && last_no == no)
+            return last;
+        auto it = resident.find(no);
+        page *pg = nullptr;
+        if (it != resident.end()) {
+            pg = &it->second;
+            if (budget)
+                lru.splice(lru.begin(), lru, pg->lru_pos);
+        } else if (budget && spilled.count(no)) {
+            pg = reload(no);
+        } else if (create) {
+            pg = &resident[no];
+            if (budget) {
+                lru.push_front(no);
+                pg->lru_pos = lru.begin();
+            }
+        } else {
+            return nullptr;
+        }
+        last_no = no;
+        last = pg;
+        return pg;
+    }
+
+    void evict_over_budget(unsigned long keep) {
+        while (resident_bytes > budget && lru.size() > 1) {
+            unsigned long victim = lru.back();
+            if (victim == keep)
+                break;
+            spill_page(victim);
+        }
+    }
+
+    // page format: varint cell count, then for every cell its offset inside the page and the cell
+    void spill_page(unsigned long no) {
+        page &pg = resident[no];
+        buf.clear();
+        put_varint(buf, pg.cells.size());
+        for (auto &c : pg.cells) {
+            put_varint(buf, c.first & ((1UL << SHADOW_PAGE_BITS) - 1));
+            shadow_save(c.second, buf);
+        }
+
+        auto it = spilled.find(no);
+        if (it == spilled.end() || it->second.capacity < buf.size()) {
+            // the old slot (if any) is too small, the page is appended at the end of the file
+            spill_slot slot{spill_end, buf.size(), buf.size()};
+            spill_end += buf.size();
+            spilled[no] = slot;
+            it = spilled.find(no);
+        }
+        it->second.len = buf.size();
+        fseeko(spill, it->second.offset, SEEK_SET);
+        if (fwrite(buf.data(), 1, buf.size(), spill) != buf.size()) {
+            cout << "Failed to write shadow spill file " << spill_path << endl;
+            exit(1);
+        }
+
+        pages_spilled++;
+        bytes_spilled += buf.size();
+        resident_bytes -= min(resident_bytes, pg.bytes);
+        lru.erase(pg.lru_pos);
+        if (last == &pg)
+            last = nullptr;
+        resident.erase(no);
+    }
+
+    page *reload(unsigned long no) {
+        spill_slot &slot = spilled[no];
+        buf.resize(slot.len);
+        fseeko(spill, slot.offset, SEEK_SET);
+        if (fread(&buf[0], 1, slot.len, spill) != slot.len) {
+            cout << "Failed to read shadow spill file " << spill_path << endl;
+            exit(1);
+        }
+        pages_reloaded++;
+        bytes_reloaded += slot.len;
+
+        page &pg = resident[no];
+        const char *p = buf.data();
+        size_t n = get_varint(p);
+        pg.cells.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            unsigned long addr = (no << SHADOW_PAGE_BITS) | get_varint(p);
+            T &cell = pg.cells[addr];
+            shadow_load(cell, p);
+            pg.bytes += shadow_bytes(cell);
+        }
+        resident_bytes += pg.bytes;
+        lru.push_front(no);
+        pg.lru_pos = lru.begin();
+        // the slot is kept, the page is written back into it when it gets evicted again
+        evict_over_budget(no);
+        return &pg;
+    }
+};
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef TRACE_INDEX_H
+#define TRACE_INDEX_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <iostream>
+#include <sys/stat.h>
+
+using namespace std;
+using ll = long long;
+
+// how many trace lines lie between two consecutive snapshots of the index
+#define INDEX_INTERVAL 100000
+// bytes at the start and at the end of the trace that go into the index checksum
+#define INDEX_CHECK_BLOCK 65536
+
+//
+// One checkpoint of the synchronization state. It remembers where in the trace file we were
+// (line count and byte offset of the next line) and the thread/lock vector clocks at that point.
+// Shadow memory is NOT part of the snapshot, a window always starts with empty memory clocks.
+//
+struct trace_snapshot {
+    ll line = 0;                          // number of lines consumed before this snapshot
+    long long offset = 0;                 // byte offset of line (line + 1) in the trace file
+    ll t_count = 0;                       // total threads created till now
+    unsigned long parent_tid = 0;         // parent/child tracking state of the parser
+    unsigned long no_of_child = 0;
+    bool is_parent = false;
+    map<ll, vector<ll>> threads;          // TID -> thread vector clock
+    map<unsigned long, vector<ll>> locks; // lockAddr -> lock vector clock
+};
+
+//
+// Identifies the trace an index was built for: its size, modification time (ns) and an FNV-1a
+// checksum over the first and the last INDEX_CHECK_BLOCK bytes. A trace regenerated with the same
+// size still gets a new mtime, and a copy with an old mtime still has to match the checksum.
+//
+struct trace_stamp {
+    long long size = 0;
+    long long mtime = 0;
+    unsigned long long checksum = 0;
+
+    bool operator==(const trace_stamp &o) const {
+        return size == o.size && mtime == o.mtime && checksum == o.checksum;
+    }
+    bool operator!=(const trace_stamp &o) const { return !(*this == o); }
+};
+
+void checksum_block(ifstream &file, long long from, long long len, unsigned long long &h) {
+    vector<char> buf(len);
+    file.seekg(from, ios::beg);
+    file.read(buf.data(), len);
+    for (streamsize i = 0; i < file.gcount(); ++i) {
+        h ^= (unsigned char)buf[i];
+        h *= 1099511628211ULL;
+    }
+}
+
+// leaves 'file' rewound to the beginning
+trace_stamp stamp_trace(ifstream &file, const string &trace_path) {
+    trace_stamp st;
+    file.clear();
+    file.seekg(0, ios::end);
+    st.size = (long long)file.tellg();
+
+    struct stat info;
+    if (stat(trace_path.c_str(), &info) == 0)
+        st.mtime = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+
+    st.checksum = 14695981039346656037ULL;
+    long long head = min(st.size, (long long)INDEX_CHECK_BLOCK);
+    checksum_block(file, 0, head, st.checksum);
+    // the tail block must not overlap the head one for short traces
+    long long tail_from = max(head, st.size - INDEX_CHECK_BLOCK);
+    checksum_block(file, tail_from, st.size - tail_from, st.checksum);
+
+    file.clear();
+    file.seekg(0, ios::beg);
+    return st;
+}
+
+//
+// Index over a trace file: snapshots every 'interval' lines, built by a sync-only replay.
+// It is saved next to the trace (one file per detector as they treat thread begin differently)
+// and reused as long as the stamp of the trace file did not change.
+//
+struct trace_index {
+    ll interval = INDEX_INTERVAL;
+    trace_stamp stamp;
+    vector<trace_snapshot> snaps;
+
+    // the last snapshot taken at or before 'line' lines were consumed
+    const trace_snapshot* nearest(ll line) const {
+        const trace_snapshot* best = nullptr;
+        for (auto &s : snaps) {
+            if (s.line > line)
+                break;
+            best = &s;
+        }
+        return best;
+    }
+
+    bool save(const string &idx_path) const {
+        ofstream out(idx_path);
+        if (!out.is_open())
+            return false;
+        out << "INDEX " << interval << " " << stamp.size << " " << stamp.mtime << " " << stamp.checksum << " "
+            << snaps.size() << "\n";
+        for (auto &s : snaps) {
+            out << "S " << s.line << " " << s.offset << " " << s.t_count << " " << s.parent_tid << " "
+                << s.no_of_child << " " << s.is_parent << " " << s.threads.size() << " " << s.locks.size() << "\n";
+            for (auto &p : s.threads) {
+                out << "T " << p.first << " " << p.second.size();
+                for (ll v : p.second)
+                    out << " " << v;
+                out << "\n";
+            }
+            for (auto &p : s.locks) {
+                out << "L " << p.first << " " << p.second.size();
+                for (ll v : p.second)
+                    out << " " << v;
+                out << "\n";
+            }
+        }
+        return out.good();
+    }
+
+    // returns false if the file is missing, broken or was built for a different trace
+    bool load(const string &idx_path, const trace_stamp &expected) {
+        ifstream in(idx_path);
+        if (!in.is_open())
+            return false;
+        string tag;
+        size_t count = 0;
+        if (!(in >> tag >> interval >> stamp.size >> stamp.mtime >> stamp.checksum >> count) || tag != "INDEX" ||
+            stamp != expected)
+            return false;
+        snaps.assign(count, trace_snapshot());
+        for (auto &s : snaps) {
+            size_t nthreads = 0, nlocks = 0;
+            if (!(in >> tag >> s.line >> s.offset >> s.t_count >> s.parent_tid >> s.no_of_child
+                     >> s.is_parent >> nthreads >> nlocks) || tag != "S")
+                return false;
+            for (size_t i = 0; i < nthreads + nlocks; ++i) {
+                unsigned long key = 0;
+                size_t n = 0;
+                if (!(in >> tag >> key >> n))
+                    return false;
+                vector<ll> &vc = (tag == "T") ? s.threads[(ll)key] : s.locks[key];
+                vc.resize(n);
+                for (size_t j = 0; j < n; ++j)
+                    in >> vc[j];
+            }
+            if (!in)
+                return false;
+        }
+        return true;
+    }
+};
+
+//
+// Builds the index with one pass over the trace. 'replay' must apply only the synchronization
+// side of a line (no race checks) and 'capture' must fill the clocks/parser state of a snapshot.
+//
+trace_index build_trace_index(ifstream &file, const trace_stamp &stamp, ll interval,
+                              const function<void(const string &)> &replay,
+                              const function<void(trace_snapshot &)> &capture) {
+    trace_index idx;
+    idx.interval = interval;
+    idx.stamp = stamp;
+    file.clear();
+    file.seekg(0, ios::beg);
+
+    string line;
+    ll line_no = 0;
+    while (true) {
+        if (line_no % interval == 0) {
+            trace_snapshot s;
+            s.line = line_no;
+            s.offset = (long long)file.tellg();
+            // tellg fails once the last line hit eof, nothing is left to index then
+            if (s.offset >= 0) {
+                capture(s);
+                idx.snaps.push_back(move(s));
+            }
+        }
+        if (!getline(file, line))
+            break;
+        replay(line);
+        line_no++;
+    }
+    file.clear();
+    file.seekg(0, ios::beg);
+    return idx;
+}
+
+//
+// Loads '<trace>.<algo>.idx' if it matches the trace, otherwise builds and saves it.
+// Index files written before the stamp had mtime and checksum fail to parse and are rebuilt.
+//
+trace_index load_or_build_index(ifstream &file, const string &trace_path, const string &algo,
+                                const function<void(const string &)> &replay,
+                                const function<void(trace_snapshot &)> &capture) {
+    string idx_path = trace_path + "." + algo + ".idx";
+    trace_stamp stamp = stamp_trace(file, trace_path);
+
+    trace_index idx;
+    if (idx.load(idx_path, stamp))
+        return idx;
+    idx = build_trace_index(file, stamp, INDEX_INTERVAL, replay, capture);
+    if (!idx.save(idx_path))
+        cout << "Warning: could not write trace index " << idx_path << endl;
+    return idx;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef BUCKET_LOCK_H
+#define BUCKET_LOCK_H
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+
+#include "cpu_hints.h"
+
+using namespace std;
+
+// lock attempts an embedded bucket lock spins before its thread parks
+#define BUCKET_LOCK_SPINS 128
+// futex words the parked threads are spread over (power of two)
+#define PARKING_SLOTS 256
+
+/**
+ * Lock embedded in the low bits of a bucket head word (the chain pointer is at least 8-byte
+ * aligned, so bits 0-2 are free):
+ *  - LOCKED: held by a writer,
+ *  - PARKED: at least one thread is (or is about to be) asleep waiting for it.
+ * A thread that wants the lock spins BUCKET_LOCK_SPINS times, then sets PARKED and sleeps on the
+ * futex of a parking slot chosen by the word's address. Unlock clears both bits and, only if PARKED
+ * was set, bumps the slot's sequence number and wakes its sleepers, who then compete again.
+ * A sleeper reads the sequence number before it loads the word it finds LOCKED|PARKED, so a
+ * wake-up can not get lost.
+ */
+class EmbeddedBucketLock {
+public:
+    static constexpr uintptr_t LOCKED = 1;
+    static constexpr uintptr_t PARKED = 2;
+
+private:
+    struct alignas(64) ParkingSlot {
+        atomic<uint32_t> sequence{0};
+    };
+
+    static ParkingSlot& slotOf(const atomic<uintptr_t>& word) {
+        static ParkingSlot slots[PARKING_SLOTS];
+        uintptr_t address = reinterpret_cast<uintptr_t>(&word);
+        return slots[((address >> 3) * 0x9E3779B97F4A7C15ULL >> 56) & (PARKING_SLOTS - 1)];
+    }
+
+    static void futexWait(atomic<uint32_t>& futexWord, uint32_t expected) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&futexWord), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    }
+
+    static void futexWakeAll(atomic<uint32_t>& futexWord) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&futexWord), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+public:
+    // called between the two loads of the parking loop; tests set it to widen the race window
+    static inline void (*parkingHook)() = nullptr;
+
+    static void lock(atomic<uintptr_t>& word) {
+        for (int spin = 0; spin < BUCKET_LOCK_SPINS; spin++) {
+            uintptr_t value = word.load(memory_order_relaxed);
+            if (!(value & LOCKED) &&
+                word.compare_exchange_weak(value, value | LOCKED, memory_order_acquire, memory_order_relaxed)) {
+                return;
+            }
+            cpuRelax();
+        }
+
+        ParkingSlot& slot = slotOf(word);
+        while (true) {
+            // the sequence number first: an unlock after this load changes it and the futex wait
+            // returns at once, an unlock before it is seen by the word load below
+            uint32_t sequence = slot.sequence.load(memory_order_acquire);
+            if (parkingHook) {
+                parkingHook();
+            }
+            uintptr_t value = word.load(memory_order_relaxed);
+            if (!(value & LOCKED)) {
+                if (word.compare_exchange_weak(value, value | LOCKED, memory_order_acquire, memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            if (!(value & PARKED) &&
+                !word.compare_exchange_weak(value, value | PARKED, memory_order_acq_rel, memory_order_relaxed)) {
+                continue;
+            }
+            futexWait(slot.sequence, sequence);
+        }
+    }
+
+    static void unlock(atomic<uintptr_t>& word) {
+        uintptr_t previous = word.fetch_and(~(LOCKED | PARKED), memory_order_release);
+        if (previous & PARKED) {
+            ParkingSlot& slot = slotOf(word);
+            slot.sequence.fetch_add(1, memory_order_release);
+            futexWakeAll(slot.sequence);
+        }
+    }
+
+    /**
+     * Replaces the bits of the word outside of 'keep' by 'bits', keeping the lock state.
+     * Only called by the lock holder; a CAS loop because waiters may set PARKED meanwhile.
+     */
+    static void replace(atomic<uintptr_t>& word, uintptr_t bits, uintptr_t keep, memory_order order) {
+        uintptr_t value = word.load(memory_order_relaxed);
+        while (!word.compare_exchange_weak(value, bits | (value & keep), order, memory_order_relaxed)) {
+        }
+    }
+};
+
+#endif
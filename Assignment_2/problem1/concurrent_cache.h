@@ -0,0 +1,220 @@
+#ifndef CONCURRENT_CACHE_H
+#define CONCURRENT_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "concurrent_hash_table.h"
+
+using namespace std;
+
+// counter stripes of the cache statistics (power of two)
+#define CACHE_STAT_STRIPES 16
+
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expirations;
+};
+
+/**
+ * Capacity-bounded cache on top of ConcurrentHashTable with CLOCK eviction.
+ *
+ * Every cached key owns one of 'capacity' slots; the table maps the key to its value, its slot and
+ * its expiry time. A hit only sets the reference bit of the slot (a plain store, skipped if the bit
+ * is already set), so gets stay lock-free like lookup. A put of a new key claims a slot by moving
+ * the shared clock hand one slot at a time with fetch_add: a free slot is taken, a referenced slot
+ * loses its bit (second chance), an unreferenced one is evicted. There is no global lock, only the
+ * bucket lock of the key being evicted or inserted.
+ *
+ * Slot states: FREE, BUSY (claimed by one thread, skipped by the hand) and OCCUPIED. Erasing or
+ * expiring a key leaves its slot OCCUPIED with a stale key; the hand recycles it when it comes
+ * around, since evicting only removes a key whose entry still points to the slot.
+ */
+template <typename K, typename V, typename Hash = MixHash<K>, typename KeyEqual = equal_to<K>>
+class ConcurrentClockCache {
+private:
+    struct Entry {
+        V value;
+        uint32_t slot;
+        int64_t expiresAt;    // steady_clock nanoseconds, 0 = never
+    };
+
+    using Table = ConcurrentHashTable<K, Entry, Hash, KeyEqual>;
+
+    enum SlotState : uint8_t { SLOT_FREE, SLOT_BUSY, SLOT_OCCUPIED };
+
+    struct Slot {
+        atomic<uint8_t> state{SLOT_FREE};
+        atomic<uint8_t> referenced{0};
+        K key{};    // written by the thread holding the slot BUSY
+    };
+
+    struct alignas(64) StatStripe {
+        atomic<uint64_t> hits{0};
+        atomic<uint64_t> misses{0};
+        atomic<uint64_t> evictions{0};
+        atomic<uint64_t> expirations{0};
+    };
+
+    uint32_t capacity;
+    Table table;
+    vector<Slot> slots;
+    alignas(64) atomic<uint64_t> clockHand;
+    StatStripe statStripes[CACHE_STAT_STRIPES];
+
+    static int64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static StatStripe& myStripe(StatStripe* stripes) {
+        static atomic<uint32_t> nextStripe{0};
+        static thread_local uint32_t stripe = nextStripe.fetch_add(1, memory_order_relaxed) & (CACHE_STAT_STRIPES - 1);
+        return stripes[stripe];
+    }
+
+    static void bump(atomic<uint64_t>& counter) {
+        counter.fetch_add(1, memory_order_relaxed);
+    }
+
+    /**
+     * Moves the hand until it claims a slot, which is returned BUSY. An OCCUPIED slot is claimed
+     * before its key is evicted, so no two threads evict the same slot.
+     */
+    uint32_t claimSlot() {
+        while (true) {
+            uint32_t s = (uint32_t)(clockHand.fetch_add(1, memory_order_relaxed) % capacity);
+            Slot& slot = slots[s];
+            uint8_t state = slot.state.load(memory_order_acquire);
+            if (state == SLOT_BUSY) {
+                continue;
+            }
+            if (state == SLOT_OCCUPIED && slot.referenced.load(memory_order_relaxed)) {
+                slot.referenced.store(0, memory_order_relaxed);
+                continue;
+            }
+            if (!slot.state.compare_exchange_strong(state, SLOT_BUSY, memory_order_acquire)) {
+                continue;
+            }
+            if (state == SLOT_OCCUPIED) {
+                bool evicted = false;
+                table.compute(slot.key, [&](const Entry* entry) -> optional<Entry> {
+                    if (entry && entry->slot == s) {
+                        evicted = true;
+                        return nullopt;
+                    }
+                    return entry ? optional<Entry>(*entry) : nullopt;
+                });
+                if (evicted) {
+                    bump(myStripe(statStripes).evictions);
+                }
+            }
+            return s;
+        }
+    }
+
+    void releaseSlot(uint32_t s, uint8_t state) {
+        slots[s].referenced.store(state == SLOT_OCCUPIED, memory_order_relaxed);
+        slots[s].state.store(state, memory_order_release);
+    }
+
+public:
+    explicit ConcurrentClockCache(uint32_t capacity, TableOptions options = TableOptions())
+        : capacity(capacity > 0 ? capacity : 1), table(this->capacity / LOAD_FACTOR_THRESHOLD + 1, options),
+          slots(this->capacity), clockHand(0) {}
+
+    ConcurrentClockCache(const ConcurrentClockCache&) = delete;
+    ConcurrentClockCache& operator=(const ConcurrentClockCache&) = delete;
+
+    // copies the value of 'key' into 'value' if it is cached and not expired
+    bool get(const K& key, V& value) {
+        StatStripe& stats = myStripe(statStripes);
+        Entry entry;
+        if (!table.lookup(key, entry)) {
+            bump(stats.misses);
+            return false;
+        }
+        if (entry.expiresAt != 0 && entry.expiresAt <= now()) {
+            // removed unless a put renewed it meanwhile; the slot is recycled by the hand
+            table.compute(key, [&](const Entry* current) -> optional<Entry> {
+                if (current && current->slot == entry.slot && current->expiresAt == entry.expiresAt) {
+                    return nullopt;
+                }
+                return current ? optional<Entry>(*current) : nullopt;
+            });
+            bump(stats.expirations);
+            bump(stats.misses);
+            return false;
+        }
+        atomic<uint8_t>& referenced = slots[entry.slot].referenced;
+        if (!referenced.load(memory_order_relaxed)) {
+            referenced.store(1, memory_order_relaxed);
+        }
+        value = entry.value;
+        bump(stats.hits);
+        return true;
+    }
+
+    /**
+     * Caches value under key, evicting another key if all slots are taken. ttlMs = 0 never expires.
+     * A key that is already cached keeps its slot and gets the new value and expiry.
+     */
+    void put(const K& key, V value, uint64_t ttlMs = 0) {
+        int64_t expiresAt = ttlMs == 0 ? 0 : now() + (int64_t)ttlMs * 1000000;
+        bool updated = false;
+        table.compute(key, [&](const Entry* current) -> optional<Entry> {
+            if (!current) {
+                return nullopt;
+            }
+            updated = true;
+            return Entry{value, current->slot, expiresAt};
+        });
+        if (updated) {
+            return;
+        }
+
+        uint32_t s = claimSlot();
+        slots[s].key = key;
+        bool claimed = true;
+        table.compute(key, [&](const Entry* current) -> optional<Entry> {
+            if (current) {
+                // another put of the same key won the race, keep its slot
+                claimed = false;
+                return Entry{value, current->slot, expiresAt};
+            }
+            return Entry{value, s, expiresAt};
+        });
+        releaseSlot(s, claimed ? SLOT_OCCUPIED : SLOT_FREE);
+    }
+
+    bool erase(const K& key) {
+        return table.deleteKey(key);
+    }
+
+    // sums of all stripes, approximate while threads are running
+    CacheStats stats() const {
+        CacheStats total = {0, 0, 0, 0};
+        for (const StatStripe& stripe : statStripes) {
+            total.hits += stripe.hits.load(memory_order_relaxed);
+            total.misses += stripe.misses.load(memory_order_relaxed);
+            total.evictions += stripe.evictions.load(memory_order_relaxed);
+            total.expirations += stripe.expirations.load(memory_order_relaxed);
+        }
+        return total;
+    }
+
+    uint32_t getCapacity() const {
+        return capacity;
+    }
+
+    // number of cached keys, expired ones included until they are looked up or evicted
+    int64_t size() const {
+        return table.size();
+    }
+};
+
+#endif
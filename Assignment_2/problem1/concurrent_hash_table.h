@@ -2,174 +2,1192 @@
 #define CONCURRENT_HASH_TABLE_H
 
 #include <pthread.h>
+#include <sched.h>
 #include <iostream>
 #include <vector>
 #include <cassert>
 #include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "bucket_lock.h"
+#include "epoch_reclamation.h"
+#include "node_pool.h"
+#include "table_image.h"
 
 using namespace std;
 
 #define INITIAL_BUCKET_COUNT 1000
 #define LOAD_FACTOR_THRESHOLD 0.75
+// largest bucket count (the biggest power of two in a uint32_t); the table stops growing there
+#define MAX_BUCKET_COUNT (1u << 31)
+// buckets a writer moves to the new array while a resize is running
+#define MIGRATION_CHUNK 16
+// keys the bulk operations hash and prefetch before working on any of them
+#define BULK_GROUP 16
+// striped element counter: number of stripes (power of two), and the number of inserts on a
+// stripe (power of two) after which an insert sums all stripes and checks the load factor
+#define SIZE_STRIPES 64
+#define SIZE_CHECK_INTERVAL 32
 
-struct KeyValue {
-    uint32_t key;
-    uint32_t value;
+template <typename K, typename V>
+struct KeyValuePair {
+    K key;
+    V value;
 };
 
-struct Node {
-    KeyValue data;
-    Node* next;
+// the key/value type of the benchmarks
+using KeyValue = KeyValuePair<uint32_t, uint32_t>;
+
+/**
+ * Default hash of ConcurrentHashTable. Integral keys are taken as they are, other keys go through
+ * std::hash; either way the result is run through the 64-bit finalizer of MurmurHash3 so that
+ * the low bits used as bucket index depend on all bits of the key (std::hash of an integer is the
+ * identity in libstdc++, structured keys would otherwise pile up in a few buckets).
+ */
+template <typename K>
+struct MixHash {
+    size_t operator()(const K& key) const {
+        uint64_t x;
+        if constexpr (is_integral<K>::value) {
+            x = (uint64_t)key;
+        } else {
+            x = (uint64_t)hash<K>{}(key);
+        }
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return (size_t)x;
+    }
 };
 
+/**
+ * Chain node. Nodes are immutable once published except for 'next', which writers update
+ * (under the bucket lock) with release stores so that lookups can walk chains without locking.
+ */
+template <typename K, typename V>
+struct HashNode {
+    KeyValuePair<K, V> data;
+    atomic<HashNode*> next;
+};
+
+// misses answered by the negative filter, and misses that passed it and walked the chain anyway
+struct FilterStats {
+    uint64_t rejects;
+    uint64_t falsePositives;
+};
+
+// how writers lock a bucket, chosen per table (TableOptions)
+enum BucketLockMode {
+    LOCK_PTHREAD,    // a pthread_mutex_t per bucket, kept in a separate array
+    LOCK_EMBEDDED    // lock bits in the bucket head word, spin then park (bucket_lock.h)
+};
+
+struct TableOptions {
+    BucketLockMode lockMode = LOCK_PTHREAD;
+    // per-bucket fingerprint word checked by lookup and deleteKey before the chain (see BucketArray)
+    bool negativeFilter = false;
+};
+
+/**
+ * One generation of the bucket array (always a power of two buckets, indexed with 'mask').
+ * Each bucket is a single head word: the chain pointer, the MIGRATED bit and, with LOCK_EMBEDDED,
+ * the lock bits of EmbeddedBucketLock.
+ *
+ * During a resize two generations are live: the old one ('prev' of the current array) still owns
+ * every bucket that is not yet MIGRATED, the new one owns the rest. A bucket is only moved while
+ * its old lock is held, so an operation that locked an old bucket and finds it not migrated can
+ * safely work there. Lookups take no lock: they check MIGRATED before and after walking a chain.
+ *
+ * With a negative filter every bucket also has a 64-bit fingerprint word: each key of the chain sets
+ * two bits chosen by the top bits of its hash (the bucket index uses the low ones). A key whose
+ * bits are not both set is not in the chain, so most misses skip the walk. Bits are set under the
+ * bucket lock before the node is published; a delete recomputes the word from the remaining chain.
+ */
+template <typename Node>
+struct BucketArray {
+    static constexpr uintptr_t MIGRATED = 4;
+    static constexpr uintptr_t STATE_BITS = EmbeddedBucketLock::LOCKED | EmbeddedBucketLock::PARKED | MIGRATED;
+
+    uint32_t bucketCount;
+    uint32_t mask;
+    BucketLockMode lockMode;
+    atomic<uintptr_t>* heads;
+    pthread_mutex_t* bucketMutexes;    // LOCK_PTHREAD only
+    atomic<uint64_t>* filters;         // negative filter only
+    atomic<BucketArray*> next;         // newer generation, set before any bucket is migrated
+    atomic<BucketArray*> prev;         // older generation while its buckets are being moved
+    atomic<uint32_t> migrateCursor;    // next old bucket to hand out to a helper
+    atomic<uint32_t> migratedCount;
+    BucketArray* retired;              // older generations, freed with the table
+
+    BucketArray(uint32_t count, BucketLockMode lockMode, bool filtered)
+        : bucketCount(count), mask(count - 1), lockMode(lockMode), bucketMutexes(nullptr), filters(nullptr),
+          next(nullptr), prev(nullptr), migrateCursor(0), migratedCount(0), retired(nullptr) {
+        assert((count & (count - 1)) == 0);
+        heads = new atomic<uintptr_t>[bucketCount];
+        for (uint32_t i = 0; i < bucketCount; i++) {
+            heads[i].store(0, memory_order_relaxed);
+        }
+        if (lockMode == LOCK_PTHREAD) {
+            bucketMutexes = new pthread_mutex_t[bucketCount];
+            for (uint32_t i = 0; i < bucketCount; i++) {
+                pthread_mutex_init(&bucketMutexes[i], nullptr);
+            }
+        }
+        if (filtered) {
+            filters = new atomic<uint64_t>[bucketCount];
+            for (uint32_t i = 0; i < bucketCount; i++) {
+                filters[i].store(0, memory_order_relaxed);
+            }
+        }
+    }
+
+    ~BucketArray() {
+        if (bucketMutexes) {
+            for (uint32_t i = 0; i < bucketCount; i++) {
+                pthread_mutex_destroy(&bucketMutexes[i]);
+            }
+            delete[] bucketMutexes;
+        }
+        delete[] filters;
+        delete[] heads;
+    }
+
+    static Node* chainOf(uintptr_t word) {
+        return reinterpret_cast<Node*>(word & ~STATE_BITS);
+    }
+
+    Node* head(uint32_t i, memory_order order = memory_order_acquire) const {
+        return chainOf(heads[i].load(order));
+    }
+
+    bool isMigrated(uint32_t i, memory_order order = memory_order_acquire) const {
+        return heads[i].load(order) & MIGRATED;
+    }
+
+    static uint64_t filterBits(size_t hash) {
+        return (1ULL << ((uint64_t)hash >> 52 & 63)) | (1ULL << ((uint64_t)hash >> 58 & 63));
+    }
+
+    // false only if no key with this hash is in bucket i (always true without a filter)
+    bool mayContain(uint32_t i, size_t hash) const {
+        uint64_t bits = filterBits(hash);
+        return !filters || (filters[i].load(memory_order_acquire) & bits) == bits;
+    }
+
+    void lock(uint32_t i) {
+        if (lockMode == LOCK_EMBEDDED) {
+            EmbeddedBucketLock::lock(heads[i]);
+        } else {
+            pthread_mutex_lock(&bucketMutexes[i]);
+        }
+    }
+
+    void unlock(uint32_t i) {
+        if (lockMode == LOCK_EMBEDDED) {
+            EmbeddedBucketLock::unlock(heads[i]);
+        } else {
+            pthread_mutex_unlock(&bucketMutexes[i]);
+        }
+    }
+
+    // the next five are only called with bucket i locked (or before the array is shared)
+    void addToFilter(uint32_t i, size_t hash) {
+        if (filters) {
+            filters[i].store(filters[i].load(memory_order_relaxed) | filterBits(hash), memory_order_release);
+        }
+    }
+
+    void setFilter(uint32_t i, uint64_t word) {
+        filters[i].store(word, memory_order_release);
+    }
+
+    void setHead(uint32_t i, Node* node, memory_order order = memory_order_release) {
+        setWord(i, reinterpret_cast<uintptr_t>(node), order);
+    }
+
+    // empties the bucket and flags it as moved to the next generation
+    void markMigrated(uint32_t i) {
+        setWord(i, MIGRATED, memory_order_release);
+    }
+
+    void setWord(uint32_t i, uintptr_t word, memory_order order) {
+        if (lockMode == LOCK_EMBEDDED) {
+            EmbeddedBucketLock::replace(heads[i], word, EmbeddedBucketLock::LOCKED | EmbeddedBucketLock::PARKED, order);
+        } else {
+            heads[i].store(word, order);
+        }
+    }
+};
+
+/**
+ * Concurrent chained hash table from K to V. Hash must spread its result over the low bits
+ * (bucket = hash & mask), KeyEqual compares keys. Keys and values may be non-trivial types:
+ * insert moves the pair into the node, lookup copies the value out.
+ */
+template <typename K, typename V, typename Hash = MixHash<K>, typename KeyEqual = equal_to<K>>
 class ConcurrentHashTable {
+public:
+    using Pair = KeyValuePair<K, V>;
+
 private:
-    Node** table;
-    uint32_t bucketCount;
-    pthread_mutex_t* bucketMutexes;
-    atomic<int> currentSize;
+    using Node = HashNode<K, V>;
+    using Array = BucketArray<Node>;
+    // every thread allocates nodes from its own slab pool (one pool family per node type)
+    using NodeAllocator = NodePool<Node>;
+
+    /**
+     * The element count is spread over SIZE_STRIPES cache lines. A thread always updates the same
+     * stripe, so inserts and deletes of different threads do not share a counter. Summing the
+     * stripes is the exact (but slow) size; approximateSize caches the last sum.
+     */
+    struct alignas(64) SizeStripe {
+        atomic<int64_t> count{0};
+        // inserts ever counted on this stripe; unlike count it only grows, so deletes can not
+        // bring it back to a check boundary
+        atomic<uint64_t> inserts{0};
+        // negative filter: misses answered by the filter, and misses it let through to the chain
+        atomic<uint64_t> filterRejects{0};
+        atomic<uint64_t> filterFalsePositives{0};
+    };
+
+    atomic<Array*> current;
+    atomic<bool> resizeInProgress;
+    SizeStripe sizeStripes[SIZE_STRIPES];
+    atomic<int64_t> approximateSize;
+    Hash hasher;
+    KeyEqual equal;
 
-    uint32_t hashFunction(uint32_t key) {
-        return key % bucketCount;
+    // set by openImage: the mapped image and, per bucket of imageArray, whether it still lives there
+    MappedTableImage<Pair>* image;
+    Array* imageArray;
+    atomic<uint8_t>* imageBacked;
+
+    static uint32_t indexOf(size_t hash, const Array* array) {
+        return (uint32_t)hash & array->mask;
     }
 
-    void resizeTable() {
-        uint32_t newBucketCount = bucketCount * 2;
-        Node** newTable = new Node*[newBucketCount];
-        pthread_mutex_t* newMutexes = new pthread_mutex_t[newBucketCount];
+    static uint32_t stripeIndex() {
+        static atomic<uint32_t> nextStripe{0};
+        static thread_local uint32_t stripe = nextStripe.fetch_add(1, memory_order_relaxed) & (SIZE_STRIPES - 1);
+        return stripe;
+    }
 
-        for (uint32_t i = 0; i < newBucketCount; i++) {
-            newTable[i] = nullptr;
-            pthread_mutex_init(&newMutexes[i], nullptr);
+    /**
+     * Called by every SIZE_CHECK_INTERVAL-th insert on a stripe: refreshes the approximate size
+     * and starts a resize if the load factor is exceeded. The table may overshoot the threshold by
+     * at most SIZE_STRIPES * SIZE_CHECK_INTERVAL elements before this notices.
+     */
+    void checkLoadFactor() {
+        int64_t total = exactSize();
+        approximateSize.store(total, memory_order_relaxed);
+        Array* array = current.load(memory_order_acquire);
+        if (!array->prev.load(memory_order_acquire) && (double)total / array->bucketCount > LOAD_FACTOR_THRESHOLD) {
+            startResize(array);
         }
+    }
 
-        for (uint32_t i = 0; i < bucketCount; i++) {
-            Node* currentNode = table[i];
-            while (currentNode) {
-                uint32_t newIdx = currentNode->data.key % newBucketCount;
-                pthread_mutex_lock(&newMutexes[newIdx]);
-                
-                Node* newNode = new Node{currentNode->data, newTable[newIdx]};
-                newTable[newIdx] = newNode;
-                
-                pthread_mutex_unlock(&newMutexes[newIdx]);
-                currentNode = currentNode->next;
+    // clamped to MAX_BUCKET_COUNT, a larger power of two does not fit
+    static uint32_t roundUpToPowerOfTwo(uint32_t count) {
+        if (count >= MAX_BUCKET_COUNT) {
+            return MAX_BUCKET_COUNT;
+        }
+        uint32_t buckets = 1;
+        while (buckets < count) {
+            buckets <<= 1;
+        }
+        return buckets;
+    }
+
+    /**
+     * Buckets for 'count' elements at LOAD_FACTOR_THRESHOLD, rounded up and clamped to
+     * MAX_BUCKET_COUNT. The clamp comes before the conversion: a double beyond the range of the
+     * integer type it is converted to is undefined behaviour.
+     */
+    static uint32_t bucketsFor(size_t count) {
+        double wanted = ceil((double)count / LOAD_FACTOR_THRESHOLD);
+        if (wanted >= (double)MAX_BUCKET_COUNT) {
+            return MAX_BUCKET_COUNT;
+        }
+        return (uint32_t)(size_t)wanted;
+    }
+
+    // the generation every search starts from: the old array while a resize is running
+    Array* oldestLive() {
+        Array* array = current.load(memory_order_acquire);
+        Array* older = array->prev.load(memory_order_acquire);
+        return older ? older : array;
+    }
+
+    /**
+     * Locks the bucket that currently owns a key with hash 'hash' and returns its array.
+     * Starts at the oldest live generation and follows 'next' past migrated buckets.
+     */
+    Array* lockBucket(size_t hash, uint32_t& idx) {
+        Array* array = oldestLive();
+
+        while (true) {
+            idx = indexOf(hash, array);
+            array->lock(idx);
+            if (!array->isMigrated(idx, memory_order_relaxed)) {
+                copyOnWrite(array, idx);
+                return array;
             }
+            array->unlock(idx);
+            array = array->next.load(memory_order_acquire);
         }
+    }
 
-        delete[] table;
-        delete[] bucketMutexes;
+    /**
+     * Starts a resize: the new array (twice the buckets) becomes 'current' right away and the
+     * buckets are moved over by the writers afterwards, a few at a time. A table at
+     * MAX_BUCKET_COUNT buckets does not grow any more, its chains just get longer.
+     */
+    void startResize(Array* array) {
+        if (array->bucketCount >= MAX_BUCKET_COUNT) {
+            return;
+        }
+        bool expected = false;
+        if (!resizeInProgress.compare_exchange_strong(expected, true)) {
+            return;
+        }
+        if (current.load(memory_order_acquire) != array) {
+            resizeInProgress.store(false);
+            return;
+        }
 
-        table = newTable;
-        bucketMutexes = newMutexes;
-        bucketCount = newBucketCount;
+        Array* newArray = new Array(array->bucketCount * 2, array->lockMode, array->filters != nullptr);
+        newArray->prev.store(array, memory_order_relaxed);
+        newArray->retired = array;
+        array->next.store(newArray, memory_order_release);
+        current.store(newArray, memory_order_release);
     }
 
-public:
-    ConcurrentHashTable(uint32_t initialBucketCount = INITIAL_BUCKET_COUNT)
-        : bucketCount(initialBucketCount), currentSize(0) {
-        table = new Node*[bucketCount];
-        bucketMutexes = new pthread_mutex_t[bucketCount];
+    /**
+     * Moves old bucket i into buckets i and i + oldCount of the new array (hash & (2n - 1) is one of them).
+     * The nodes are copied, not relinked: a lookup may still be walking the old chain, so it has to
+     * stay intact until the copies are published and the old nodes are retired.
+     */
+    void migrateBucket(Array* oldArray, Array* newArray, uint32_t i) {
+        uint32_t low = i;
+        uint32_t high = i + oldArray->bucketCount;
 
-        for (uint32_t i = 0; i < bucketCount; i++) {
-            table[i] = nullptr;
-            pthread_mutex_init(&bucketMutexes[i], nullptr);
+        oldArray->lock(i);
+        newArray->lock(low);
+        newArray->lock(high);
+        copyOnWrite(oldArray, i);
+
+        // new chains are built in the same order as the old one
+        Node* oldChain = oldArray->head(i, memory_order_relaxed);
+        Node* tails[2] = {nullptr, nullptr};
+        for (Node* currentNode = oldChain; currentNode; currentNode = currentNode->next.load(memory_order_relaxed)) {
+            uint32_t newIdx = indexOf(hasher(currentNode->data.key), newArray);
+            int side = newIdx == high;
+            newArray->addToFilter(newIdx, hasher(currentNode->data.key));
+            Node* copy = NodeAllocator::create(currentNode->data, nullptr);
+            if (tails[side]) {
+                tails[side]->next.store(copy, memory_order_relaxed);
+            } else {
+                newArray->setHead(newIdx, copy, memory_order_relaxed);
+            }
+            tails[side] = copy;
         }
+        // publishes the copies, a lookup that sees the flag reads the new bucket
+        oldArray->markMigrated(i);
+        retireChain(oldChain);
+
+        newArray->unlock(high);
+        newArray->unlock(low);
+        oldArray->unlock(i);
     }
 
-    ~ConcurrentHashTable() {
-        for (uint32_t i = 0; i < bucketCount; i++) {
-            Node* currentNode = table[i];
-            while (currentNode) {
-                Node* tempNode = currentNode;
-                currentNode = currentNode->next;
-                delete tempNode;
+    /**
+     * Called by writers: moves up to MIGRATION_CHUNK buckets of a running resize.
+     * The helper that moves the last bucket detaches the old array.
+     */
+    void helpMigrate() {
+        Array* newArray = current.load(memory_order_acquire);
+        Array* oldArray = newArray->prev.load(memory_order_acquire);
+        if (!oldArray) {
+            return;
+        }
+
+        uint32_t start = oldArray->migrateCursor.fetch_add(MIGRATION_CHUNK);
+        if (start >= oldArray->bucketCount) {
+            return;
+        }
+        uint32_t end = min(start + MIGRATION_CHUNK, oldArray->bucketCount);
+        for (uint32_t i = start; i < end; i++) {
+            migrateBucket(oldArray, newArray, i);
+        }
+
+        uint32_t done = oldArray->migratedCount.fetch_add(end - start) + (end - start);
+        if (done == oldArray->bucketCount) {
+            newArray->prev.store(nullptr, memory_order_release);
+            resizeInProgress.store(false);
+        }
+    }
+
+    static void retireChain(Node* chain) {
+        while (chain) {
+            Node* nextNode = chain->next.load(memory_order_relaxed);
+            EpochDomain::instance().retire(chain, NodeAllocator::destroyErased);
+            chain = nextNode;
+        }
+    }
+
+    /**
+     * Moves bucket idx of an opened image into the table before its first change; called with the
+     * bucket locked. The nodes are linked in image order and published before the flag is cleared,
+     * so a lookup that sees the flag cleared also sees the chain.
+     */
+    void copyOnWrite(Array* array, uint32_t idx) {
+        if (array != imageArray || !imageBacked[idx].load(memory_order_relaxed)) {
+            return;
+        }
+        Node* chain = nullptr;
+        for (const Pair* p = image->bucketEnd(idx); p != image->bucketBegin(idx);) {
+            --p;
+            chain = NodeAllocator::create(*p, chain);
+            array->addToFilter(idx, hasher(p->key));
+        }
+        array->setHead(idx, chain);
+        imageBacked[idx].store(0, memory_order_release);
+    }
+
+    // true if bucket idx of 'array' is still only in the mapped image
+    bool inImage(const Array* array, uint32_t idx, memory_order order = memory_order_acquire) const {
+        return array == imageArray && imageBacked[idx].load(order);
+    }
+
+    // appends the pairs of bucket idx to 'out'; called with the bucket locked
+    void collectBucket(Array* array, uint32_t idx, vector<Pair>& out) {
+        if (inImage(array, idx, memory_order_relaxed)) {
+            out.insert(out.end(), image->bucketBegin(idx), image->bucketEnd(idx));
+            return;
+        }
+        for (Node* currentNode = array->head(idx, memory_order_relaxed); currentNode;
+             currentNode = currentNode->next.load(memory_order_relaxed)) {
+            out.push_back(currentNode->data);
+        }
+    }
+
+    /**
+     * Keeps resizes from starting while it is alive and waits for a running one to finish (helping
+     * it), so that 'current' is the only generation. Writers go on meanwhile, past the load factor
+     * if need be; the next insert that checks it after the pause starts the resize.
+     */
+    struct ResizePause {
+        ConcurrentHashTable& table;
+
+        explicit ResizePause(ConcurrentHashTable& table) : table(table) {
+            while (true) {
+                bool expected = false;
+                if (table.resizeInProgress.compare_exchange_strong(expected, true)) {
+                    return;
+                }
+                table.helpMigrate();
+                sched_yield();
+            }
+        }
+
+        ~ResizePause() {
+            table.resizeInProgress.store(false);
+        }
+    };
+
+    // unsynchronized walk over all nodes, only used by the destructor
+    template <typename Visitor>
+    void forEachNode(Visitor visit) {
+        Array* array = current.load(memory_order_acquire);
+        Array* older = array->prev.load(memory_order_acquire);
+        for (Array* a : {older, array}) {
+            if (!a) {
+                continue;
+            }
+            for (uint32_t i = 0; i < a->bucketCount; i++) {
+                for (Node* currentNode = a->head(i); currentNode;
+                     currentNode = currentNode->next.load(memory_order_acquire)) {
+                    visit(currentNode);
+                }
+            }
+        }
+    }
+
+    /**
+     * Lookup body, the caller holds an EpochGuard. A miss is only final if the bucket was still
+     * not migrated after the walk, otherwise the key may have moved to the newer array meanwhile.
+     */
+    bool findInEpoch(const K& key, size_t hash, V& value) {
+        Array* array = oldestLive();
+
+        while (true) {
+            uint32_t idx = indexOf(hash, array);
+            if (inImage(array, idx)) {
+                // image buckets never change, the answer holds as of the flag load
+                for (const Pair* p = image->bucketBegin(idx); p != image->bucketEnd(idx); ++p) {
+                    if (equal(p->key, key)) {
+                        value = p->value;
+                        return true;
+                    }
+                }
+                return false;
+            }
+            uintptr_t word = array->heads[idx].load(memory_order_acquire);
+            if (!(word & Array::MIGRATED)) {
+                bool filtered = !array->mayContain(idx, hash);
+                Node* currentNode = filtered ? nullptr : Array::chainOf(word);
+                while (currentNode) {
+                    if (equal(currentNode->data.key, key)) {
+                        value = currentNode->data.value;
+                        return true;
+                    }
+                    currentNode = currentNode->next.load(memory_order_acquire);
+                }
+                if (!array->isMigrated(idx)) {
+                    countFilterMiss(array, filtered);
+                    return false;
+                }
+            }
+            array = array->next.load(memory_order_acquire);
+        }
+    }
+
+    /**
+     * Prefetches the bucket heads (and, for writers, the pthread mutexes) of up to BULK_GROUP hashes,
+     * so that the misses of the whole group overlap. The array is only a hint: the operations
+     * themselves still find the owning bucket as usual if a resize moved it.
+     */
+    void prefetchGroup(const size_t* hashes, size_t n, bool forWrite, Array*& array, uint32_t* idx) {
+        array = oldestLive();
+        for (size_t i = 0; i < n; i++) {
+            idx[i] = indexOf(hashes[i], array);
+            if (forWrite) {
+                __builtin_prefetch(&array->heads[idx[i]], 1);
+                if (array->bucketMutexes) {
+                    __builtin_prefetch(&array->bucketMutexes[idx[i]], 1);
+                }
+            } else {
+                __builtin_prefetch(&array->heads[idx[i]], 0);
             }
         }
-        delete[] table;
-        delete[] bucketMutexes;
     }
 
-    void insert(KeyValue kv) {
-        if ((float)currentSize / bucketCount > LOAD_FACTOR_THRESHOLD) {
-            resizeTable();
+    // second stage: the bucket heads are (hopefully) cached now, fetch the first node of each chain
+    static void prefetchHeads(Array* array, const uint32_t* idx, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            Node* head = array->head(idx[i]);
+            if (head) {
+                __builtin_prefetch(head, 0);
+            }
         }
+    }
 
-        uint32_t idx = hashFunction(kv.key);
-        pthread_mutex_lock(&bucketMutexes[idx]);
+    /**
+     * A key's place in its bucket: the node holding it (nullptr if absent) and the node before it
+     * (nullptr if it is the head). lockAndFind returns with the bucket locked.
+     */
+    struct Position {
+        Array* owner;
+        uint32_t idx;
+        Node* prev;
+        Node* node;
+    };
 
-        Node* newNode = new Node{kv, table[idx]};
-        table[idx] = newNode;
+    Position lockAndFind(const K& key, size_t hash) {
+        Position pos;
+        pos.owner = lockBucket(hash, pos.idx);
+        pos.prev = nullptr;
+        pos.node = pos.owner->head(pos.idx, memory_order_relaxed);
+        while (pos.node && !equal(pos.node->data.key, key)) {
+            pos.prev = pos.node;
+            pos.node = pos.node->next.load(memory_order_relaxed);
+        }
+        return pos;
+    }
 
-        pthread_mutex_unlock(&bucketMutexes[idx]);
-        currentSize++;
+    /**
+     * deleteKey fast path: true if the negative filter shows the key is absent, checked without
+     * any lock in every generation the key may be in (like a lookup). Image buckets have no filter.
+     */
+    bool filteredOut(size_t hash) {
+        Array* array = oldestLive();
+        while (true) {
+            uint32_t idx = indexOf(hash, array);
+            if (!array->filters || inImage(array, idx)) {
+                return false;
+            }
+            if (!array->isMigrated(idx)) {
+                if (array->mayContain(idx, hash)) {
+                    return false;
+                }
+                if (!array->isMigrated(idx)) {
+                    countFilterMiss(array, true);
+                    return true;
+                }
+            }
+            array = array->next.load(memory_order_acquire);
+        }
     }
 
-    bool deleteKey(uint32_t key) {
-        uint32_t idx = hashFunction(key);
-        pthread_mutex_lock(&bucketMutexes[idx]);
+    void countFilterMiss(const Array* array, bool filtered) {
+        if (array->filters) {
+            SizeStripe& stripe = sizeStripes[stripeIndex()];
+            (filtered ? stripe.filterRejects : stripe.filterFalsePositives).fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    // rebuilds the filter word of a locked bucket after a node left its chain
+    void refreshFilter(Array* array, uint32_t idx) {
+        if (!array->filters) {
+            return;
+        }
+        uint64_t word = 0;
+        for (Node* currentNode = array->head(idx, memory_order_relaxed); currentNode;
+             currentNode = currentNode->next.load(memory_order_relaxed)) {
+            word |= Array::filterBits(hasher(currentNode->data.key));
+        }
+        array->setFilter(idx, word);
+    }
 
-        Node* currentNode = table[idx];
-        Node* prevNode = nullptr;
+    // makes 'node' the successor of pos.prev (or the bucket head)
+    static void linkAfterPrev(const Position& pos, Node* node) {
+        if (pos.prev) {
+            pos.prev->next.store(node, memory_order_release);
+        } else {
+            pos.owner->setHead(pos.idx, node);
+        }
+    }
 
-        while (currentNode) {
-            if (currentNode->data.key == key) {
-                if (prevNode) {
-                    prevNode->next = currentNode->next;
-                } else {
-                    table[idx] = currentNode->next;
+    // puts 'fresh' in place of pos.node, unlocks the bucket and retires the old node
+    static void replaceNode(const Position& pos, Node* fresh) {
+        fresh->next.store(pos.node->next.load(memory_order_relaxed), memory_order_relaxed);
+        linkAfterPrev(pos, fresh);
+        pos.owner->unlock(pos.idx);
+        EpochDomain::instance().retire(pos.node, NodeAllocator::destroyErased);
+    }
+
+    // unlinks pos.node, unlocks the bucket and retires the node
+    void removeNode(const Position& pos) {
+        linkAfterPrev(pos, pos.node->next.load(memory_order_relaxed));
+        refreshFilter(pos.owner, pos.idx);
+        pos.owner->unlock(pos.idx);
+        // lookups may still be standing on the node
+        EpochDomain::instance().retire(pos.node, NodeAllocator::destroyErased);
+        countDelete();
+    }
+
+    // adds 'fresh' at the head of the bucket of a key that is absent and unlocks the bucket
+    void pushNode(const Position& pos, size_t hash, Node* fresh) {
+        pos.owner->addToFilter(pos.idx, hash);
+        fresh->next.store(pos.owner->head(pos.idx, memory_order_relaxed), memory_order_relaxed);
+        pos.owner->setHead(pos.idx, fresh);
+        pos.owner->unlock(pos.idx);
+        countInsert();
+    }
+
+    // insert body for a precomputed hash, the caller already helped a running resize
+    void insertHashed(Pair kv, size_t hash) {
+        uint32_t idx;
+        Array* owner = lockBucket(hash, idx);
+
+        owner->addToFilter(idx, hash);
+        Node* newNode = NodeAllocator::create(std::move(kv), owner->head(idx, memory_order_relaxed));
+        owner->setHead(idx, newNode);
+
+        owner->unlock(idx);
+        countInsert();
+    }
+
+    // deleteKey body for a precomputed hash, the caller already helped a running resize
+    bool deleteHashed(const K& key, size_t hash) {
+        if (filteredOut(hash)) {
+            return false;
+        }
+
+        Position pos = lockAndFind(key, hash);
+        if (!pos.node) {
+            pos.owner->unlock(pos.idx);
+            return false;
+        }
+        removeNode(pos);
+        return true;
+    }
+
+    void countInsert() {
+        SizeStripe& stripe = sizeStripes[stripeIndex()];
+        stripe.count.fetch_add(1, memory_order_relaxed);
+        uint64_t stripeInserts = stripe.inserts.fetch_add(1, memory_order_relaxed) + 1;
+        if ((stripeInserts & (SIZE_CHECK_INTERVAL - 1)) == 0) {
+            checkLoadFactor();
+        }
+    }
+
+    void countDelete() {
+        sizeStripes[stripeIndex()].count.fetch_sub(1, memory_order_relaxed);
+    }
+
+    /**
+     * State of a bulk load. The buckets are split into 'partitions' contiguous ranges (the top
+     * bits of the bucket index). counts holds, per thread and partition, first the number of
+     * input pairs and then the next free slot of that thread in 'order'.
+     */
+    struct BulkLoad {
+        ConcurrentHashTable* table;
+        Array* array;
+        const Pair* pairs;
+        size_t count;
+        int threads;
+        uint32_t partitions;
+        int partitionShift;
+        vector<uint32_t> bucketOf;
+        vector<size_t> counts;
+        vector<size_t> partitionStart;
+        vector<size_t> order;
+        atomic<uint32_t> nextPartition;
+        pthread_barrier_t barrier;
+    };
+
+    struct BulkLoadWorker {
+        BulkLoad* load;
+        int id;
+    };
+
+    /**
+     * Counting sort of the input by partition, then chain building: every thread hashes its slice
+     * and counts its pairs per partition, thread 0 turns the counts into offsets, every thread
+     * scatters the indices of its slice into 'order', and finally the threads claim whole
+     * partitions and link their nodes. A partition is only ever touched by one thread and the
+     * table is not shared yet, so no bucket is locked; pthread_join publishes the chains.
+     */
+    static void* bulkLoadWorker(void* args) {
+        BulkLoadWorker* worker = static_cast<BulkLoadWorker*>(args);
+        BulkLoad& load = *worker->load;
+        size_t begin = load.count * worker->id / load.threads;
+        size_t end = load.count * (worker->id + 1) / load.threads;
+        size_t* myCounts = &load.counts[(size_t)worker->id * load.partitions];
+
+        for (size_t i = begin; i < end; i++) {
+            uint32_t idx = indexOf(load.table->hasher(load.pairs[i].key), load.array);
+            load.bucketOf[i] = idx;
+            myCounts[idx >> load.partitionShift]++;
+        }
+        pthread_barrier_wait(&load.barrier);
+
+        if (worker->id == 0) {
+            size_t offset = 0;
+            for (uint32_t p = 0; p < load.partitions; p++) {
+                load.partitionStart[p] = offset;
+                for (int t = 0; t < load.threads; t++) {
+                    size_t c = load.counts[(size_t)t * load.partitions + p];
+                    load.counts[(size_t)t * load.partitions + p] = offset;
+                    offset += c;
                 }
-                delete currentNode;
-                pthread_mutex_unlock(&bucketMutexes[idx]);
-                currentSize--;
-                return true;
             }
-            prevNode = currentNode;
-            currentNode = currentNode->next;
+            load.partitionStart[load.partitions] = offset;
+        }
+        pthread_barrier_wait(&load.barrier);
+
+        for (size_t i = begin; i < end; i++) {
+            load.order[myCounts[load.bucketOf[i] >> load.partitionShift]++] = i;
+        }
+        pthread_barrier_wait(&load.barrier);
+
+        uint32_t p;
+        while ((p = load.nextPartition.fetch_add(1, memory_order_relaxed)) < load.partitions) {
+            for (size_t j = load.partitionStart[p]; j < load.partitionStart[p + 1]; j++) {
+                size_t i = load.order[j];
+                uint32_t idx = load.bucketOf[i];
+                Node* node = NodeAllocator::create(load.pairs[i], load.array->head(idx, memory_order_relaxed));
+                load.array->addToFilter(idx, load.table->hasher(load.pairs[i].key));
+                load.array->heads[idx].store(reinterpret_cast<uintptr_t>(node), memory_order_relaxed);
+            }
+        }
+        return nullptr;
+    }
+
+    void bulkLoad(const Pair* pairs, size_t count, int threads) {
+        BulkLoad load;
+        load.table = this;
+        load.array = current.load(memory_order_relaxed);
+        load.pairs = pairs;
+        load.count = count;
+        load.threads = threads > 0 ? threads : 1;
+        // a few partitions per thread so that the dynamic hand-out evens out skewed partitions
+        load.partitions = 1;
+        while (load.partitions < (uint32_t)load.threads * 8 && load.partitions < load.array->bucketCount) {
+            load.partitions <<= 1;
+        }
+        load.partitionShift = __builtin_ctz(load.array->bucketCount) - __builtin_ctz(load.partitions);
+        load.bucketOf.resize(count);
+        load.counts.assign((size_t)load.threads * load.partitions, 0);
+        load.partitionStart.resize(load.partitions + 1);
+        load.order.resize(count);
+        load.nextPartition.store(0, memory_order_relaxed);
+        pthread_barrier_init(&load.barrier, nullptr, load.threads);
+
+        vector<pthread_t> loaders(load.threads);
+        vector<BulkLoadWorker> workers(load.threads);
+        for (int t = 0; t < load.threads; t++) {
+            workers[t] = BulkLoadWorker{&load, t};
+            pthread_create(&loaders[t], nullptr, bulkLoadWorker, &workers[t]);
+        }
+        for (int t = 0; t < load.threads; t++) {
+            pthread_join(loaders[t], nullptr);
+        }
+        pthread_barrier_destroy(&load.barrier);
+
+        sizeStripes[0].count.store((int64_t)count, memory_order_relaxed);
+        approximateSize.store((int64_t)count, memory_order_relaxed);
+    }
+
+public:
+    // the bucket count is rounded up to a power of two, at most MAX_BUCKET_COUNT
+    ConcurrentHashTable(uint32_t initialBucketCount = INITIAL_BUCKET_COUNT, TableOptions options = TableOptions(),
+                        const Hash& hasher = Hash(), const KeyEqual& equal = KeyEqual())
+        : current(new Array(roundUpToPowerOfTwo(initialBucketCount), options.lockMode, options.negativeFilter)),
+          resizeInProgress(false),
+          approximateSize(0), hasher(hasher), equal(equal), image(nullptr), imageArray(nullptr),
+          imageBacked(nullptr) {}
+
+    /**
+     * Bulk-load constructor: builds the table from 'count' pairs with 'threads' threads, sized so
+     * that the load factor stays within LOAD_FACTOR_THRESHOLD (up to MAX_BUCKET_COUNT buckets).
+     * The input is partitioned by bucket range (bulkLoadWorker) and every range is linked without
+     * locks, so the build is bound by memory bandwidth. Like insert, duplicate keys are all kept.
+     */
+    ConcurrentHashTable(const Pair* pairs, size_t count, int threads, TableOptions options = TableOptions(),
+                        const Hash& hasher = Hash(), const KeyEqual& equal = KeyEqual())
+        : ConcurrentHashTable(bucketsFor(count), options, hasher, equal) {
+        bulkLoad(pairs, count, threads);
+    }
+
+    ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+    ConcurrentHashTable& operator=(const ConcurrentHashTable&) = delete;
+
+    ~ConcurrentHashTable() {
+        vector<Node*> nodes;
+        forEachNode([&](Node* node) { nodes.push_back(node); });
+        for (Node* node : nodes) {
+            NodeAllocator::destroy(node);
+        }
+
+        Array* array = current.load();
+        while (array) {
+            Array* older = array->retired;
+            delete array;
+            array = older;
+        }
+        delete[] imageBacked;
+        delete image;
+    }
+
+    /**
+     * Warm start from an image written by saveImage: maps the file and returns a table that reads
+     * its buckets from the mapping until they are first written (or moved by a resize), at which
+     * point the bucket is copied into nodes. Lookups of untouched buckets scan the image in place.
+     * Returns nullptr if the file is not a valid image for this Pair type; the Hash must be the one
+     * the image was saved with.
+     */
+    static ConcurrentHashTable* openImage(const string& path, TableOptions options = TableOptions(),
+                                          const Hash& hasher = Hash(), const KeyEqual& equal = KeyEqual()) {
+        MappedTableImage<Pair>* mapped = new MappedTableImage<Pair>();
+        if (!mapped->open(path)) {
+            delete mapped;
+            return nullptr;
+        }
+        uint32_t buckets = (uint32_t)mapped->bucketCount();
+        ConcurrentHashTable* table = new ConcurrentHashTable(buckets, options, hasher, equal);
+        table->image = mapped;
+        table->imageArray = table->current.load(memory_order_relaxed);
+        table->imageBacked = new atomic<uint8_t>[buckets];
+        for (uint32_t i = 0; i < buckets; i++) {
+            table->imageBacked[i].store(mapped->bucketBegin(i) != mapped->bucketEnd(i), memory_order_relaxed);
+        }
+        table->sizeStripes[0].count.store((int64_t)mapped->pairCount(), memory_order_relaxed);
+        table->approximateSize.store((int64_t)mapped->pairCount(), memory_order_relaxed);
+        return table;
+    }
+
+    /**
+     * Writes the table to 'path' in the format of table_image.h (K and V must be trivially
+     * copyable). The buckets are copied one at a time like in forEach, so writers may keep running;
+     * the image then holds every pair that was present during the whole save. Returns false on an
+     * I/O error.
+     */
+    bool saveImage(const string& path) {
+        ResizePause pause(*this);
+        Array* array = current.load(memory_order_acquire);
+        TableImageWriter<Pair> writer;
+        if (!writer.open(path, array->bucketCount)) {
+            return false;
+        }
+        vector<Pair> bucket;
+        for (uint32_t i = 0; i < array->bucketCount; i++) {
+            array->lock(i);
+            collectBucket(array, i, bucket);
+            array->unlock(i);
+            writer.writeBucket(i, bucket.data(), bucket.size());
+            bucket.clear();
+        }
+        return writer.finish();
+    }
+
+    void insert(Pair kv) {
+        size_t hash = hasher(kv.key);
+        Array* array = current.load(memory_order_acquire);
+        if (array->prev.load(memory_order_acquire)) {
+            helpMigrate();
+        }
+        insertHashed(std::move(kv), hash);
+    }
+
+    void insert(K key, V value) {
+        insert(Pair{std::move(key), std::move(value)});
+    }
+
+    // with a negative filter, a delete of an absent key usually returns without locking
+    bool deleteKey(const K& key) {
+        size_t hash = hasher(key);
+        helpMigrate();
+        return deleteHashed(key, hash);
+    }
+
+    /**
+     * Inserts kv or replaces the value of its key; returns true if the key was new.
+     *
+     * Unlike insert, upsert, insertIfAbsent, compute and fetchAdd keep keys unique: each one locks
+     * the bucket once, looks for the key and changes the bucket in the same critical section.
+     * An existing node is never modified in place (lookups read it without locking), it is replaced
+     * by a new node with the new value and retired.
+     */
+    bool upsert(Pair kv) {
+        size_t hash = hasher(kv.key);
+        helpMigrate();
+
+        Position pos = lockAndFind(kv.key, hash);
+        if (pos.node) {
+            replaceNode(pos, NodeAllocator::create(std::move(kv), nullptr));
+            return false;
+        }
+        pushNode(pos, hash, NodeAllocator::create(std::move(kv), nullptr));
+        return true;
+    }
+
+    // inserts kv only if its key is not present; returns true if it was inserted
+    bool insertIfAbsent(Pair kv) {
+        size_t hash = hasher(kv.key);
+        helpMigrate();
+
+        Position pos = lockAndFind(kv.key, hash);
+        if (pos.node) {
+            pos.owner->unlock(pos.idx);
+            return false;
+        }
+        pushNode(pos, hash, NodeAllocator::create(std::move(kv), nullptr));
+        return true;
+    }
+
+    /**
+     * Calls fn(const V* current) with the current value of 'key' (nullptr if absent) and stores
+     * the optional<V> it returns; an empty result removes the key. fn runs under the bucket lock,
+     * so it must be short and must not use the table. Returns true if the key is present afterwards.
+     */
+    template <typename Fn>
+    bool compute(const K& key, Fn fn) {
+        size_t hash = hasher(key);
+        helpMigrate();
+
+        Position pos = lockAndFind(key, hash);
+        optional<V> result = fn(pos.node ? &pos.node->data.value : static_cast<const V*>(nullptr));
+        if (!result) {
+            if (!pos.node) {
+                pos.owner->unlock(pos.idx);
+                return false;
+            }
+            removeNode(pos);
+            return false;
+        }
+        if (pos.node) {
+            replaceNode(pos, NodeAllocator::create(Pair{pos.node->data.key, std::move(*result)}, nullptr));
+        } else {
+            pushNode(pos, hash, NodeAllocator::create(Pair{key, std::move(*result)}, nullptr));
         }
+        return true;
+    }
 
-        pthread_mutex_unlock(&bucketMutexes[idx]);
-        return false;
+    // adds delta to the value of 'key' (inserting V() + delta if absent); returns the previous value
+    V fetchAdd(const K& key, V delta) {
+        V previous = V();
+        compute(key, [&](const V* current) {
+            if (current) {
+                previous = *current;
+            }
+            return optional<V>(previous + delta);
+        });
+        return previous;
     }
 
-    bool lookup(uint32_t key, uint32_t &value) {
-        uint32_t idx = hashFunction(key);
-        pthread_mutex_lock(&bucketMutexes[idx]);
+    /**
+     * Lock-free: no bucket lock and no store to shared memory (with a negative filter, a miss bumps a
+     * counter on the thread's own stripe). Nodes reached inside the epoch guard are not freed until
+     * the guard is left.
+     */
+    bool lookup(const K& key, V& value) {
+        EpochGuard guard;
+        return findInEpoch(key, hasher(key), value);
+    }
 
-        Node* currentNode = table[idx];
-        while (currentNode) {
-            if (currentNode->data.key == key) {
-                value = currentNode->data.value;
-                pthread_mutex_unlock(&bucketMutexes[idx]);
-                return true;
+    /**
+     * Bulk variants of insert, lookup and deleteKey. Keys are handled in groups of BULK_GROUP:
+     * all buckets of a group are prefetched before the first one is touched, so a thread waits
+     * for one round of cache misses per group instead of one per key. Each key is still processed
+     * with the same locking as the single-key operation, in order, using the hash computed for the
+     * prefetch; a running resize is helped once per group instead of once per key.
+     */
+    void insertMany(const Pair* kvs, size_t count) {
+        size_t hashes[BULK_GROUP];
+        uint32_t idx[BULK_GROUP];
+        Array* array;
+        for (size_t base = 0; base < count; base += BULK_GROUP) {
+            size_t n = min((size_t)BULK_GROUP, count - base);
+            for (size_t i = 0; i < n; i++) {
+                hashes[i] = hasher(kvs[base + i].key);
+            }
+            if (current.load(memory_order_acquire)->prev.load(memory_order_acquire)) {
+                helpMigrate();
+            }
+            prefetchGroup(hashes, n, true, array, idx);
+            for (size_t i = 0; i < n; i++) {
+                insertHashed(kvs[base + i], hashes[i]);
             }
-            currentNode = currentNode->next;
         }
+    }
 
-        pthread_mutex_unlock(&bucketMutexes[idx]);
-        return false;
+    // values[i] and found[i] receive the result for keys[i], returns the number of keys found
+    size_t lookupMany(const K* keys, size_t count, V* values, bool* found) {
+        size_t hits = 0;
+        size_t hashes[BULK_GROUP];
+        uint32_t idx[BULK_GROUP];
+        Array* array;
+        for (size_t base = 0; base < count; base += BULK_GROUP) {
+            size_t n = min((size_t)BULK_GROUP, count - base);
+            for (size_t i = 0; i < n; i++) {
+                hashes[i] = hasher(keys[base + i]);
+            }
+            EpochGuard guard;
+            prefetchGroup(hashes, n, false, array, idx);
+            prefetchHeads(array, idx, n);
+            for (size_t i = 0; i < n; i++) {
+                found[base + i] = findInEpoch(keys[base + i], hashes[i], values[base + i]);
+                hits += found[base + i];
+            }
+        }
+        return hits;
     }
 
-    void printTableContents() {
-        for (uint32_t i = 0; i < bucketCount; i++) {
-            Node* currentNode = table[i];
-            while (currentNode) {
-                cout << "Key: " << currentNode->data.key << " Value: " << currentNode->data.value << endl;
-                currentNode = currentNode->next;
+    // returns the number of keys that were present and removed
+    size_t deleteMany(const K* keys, size_t count) {
+        size_t removed = 0;
+        size_t hashes[BULK_GROUP];
+        uint32_t idx[BULK_GROUP];
+        Array* array;
+        for (size_t base = 0; base < count; base += BULK_GROUP) {
+            size_t n = min((size_t)BULK_GROUP, count - base);
+            for (size_t i = 0; i < n; i++) {
+                hashes[i] = hasher(keys[base + i]);
+            }
+            helpMigrate();
+            // the heads are read outside of the bucket locks, the guard keeps them allocated
+            EpochGuard guard;
+            prefetchGroup(hashes, n, true, array, idx);
+            prefetchHeads(array, idx, n);
+            for (size_t i = 0; i < n; i++) {
+                removed += deleteHashed(keys[base + i], hashes[i]);
             }
         }
+        return removed;
     }
 
-    void runUnitTest() {
-        cout << "Running unit test...\n";
-        for (uint32_t i = 0; i < bucketCount; i++) {
-            Node* currentNode = table[i];
-            while (currentNode) {
-                cout << "Key: " << currentNode->data.key << " Value: " << currentNode->data.value << endl;
-                currentNode = currentNode->next;
+    // slabs, live nodes and nodes freed by a thread other than their owner, over all tables of this type
+    static PoolStats allocatorStats() {
+        return NodeAllocator::stats();
+    }
+
+    // element count as of the last load factor check, one load
+    int64_t size() const {
+        return approximateSize.load(memory_order_relaxed);
+    }
+
+    // negative filter counters over all stripes (zero without a filter)
+    FilterStats filterStats() const {
+        FilterStats total = {0, 0};
+        for (const SizeStripe& stripe : sizeStripes) {
+            total.rejects += stripe.filterRejects.load(memory_order_relaxed);
+            total.falsePositives += stripe.filterFalsePositives.load(memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // sums all stripes; exact when no insert or delete runs at the same time
+    int64_t exactSize() const {
+        int64_t total = 0;
+        for (const SizeStripe& stripe : sizeStripes) {
+            total += stripe.count.load(memory_order_relaxed);
+        }
+        return total;
+    }
+
+    uint32_t getBucketCount() {
+        return current.load(memory_order_acquire)->bucketCount;
+    }
+
+    /**
+     * Calls visit(key, value) for every pair, safe while other threads use the table. Each bucket
+     * is copied under its lock and resizes wait until the walk is over, so every pair present for
+     * the whole walk is visited exactly once and the pairs of one bucket are seen as of one moment.
+     * visit runs without any lock held and may change the table, but must not walk it again.
+     */
+    template <typename Visitor>
+    void forEach(Visitor visit) {
+        ResizePause pause(*this);
+        Array* array = current.load(memory_order_acquire);
+        vector<Pair> bucket;
+        for (uint32_t i = 0; i < array->bucketCount; i++) {
+            array->lock(i);
+            collectBucket(array, i, bucket);
+            array->unlock(i);
+            for (const Pair& kv : bucket) {
+                visit(kv.key, kv.value);
             }
+            bucket.clear();
         }
     }
+
+    // copy of all pairs, with the guarantees of forEach
+    vector<Pair> snapshot() {
+        vector<Pair> pairs;
+        pairs.reserve(size());
+        forEach([&](const K& key, const V& value) { pairs.push_back(Pair{key, value}); });
+        return pairs;
+    }
+
+    void printTableContents() {
+        forEach([](const K& key, const V& value) { cout << "Key: " << key << " Value: " << value << endl; });
+    }
+
+    void runUnitTest() {
+        cout << "Running unit test...\n";
+        printTableContents();
+    }
 };
 
 #endif
@@ -0,0 +1,18 @@
+#ifndef CPU_HINTS_H
+#define CPU_HINTS_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// alignment that keeps independently written data on separate cache lines
+#define CACHE_LINE_SIZE 64
+
+// tells the CPU that the caller is busy-waiting (PAUSE on x86, nothing elsewhere)
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+#endif
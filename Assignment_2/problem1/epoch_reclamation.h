@@ -0,0 +1,161 @@
+#ifndef EPOCH_RECLAMATION_H
+#define EPOCH_RECLAMATION_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// retire() calls between two attempts to advance the global epoch
+#define EPOCH_SCAN_THRESHOLD 64
+
+/**
+ * Epoch-based reclamation for the lock-free read paths of the hash tables.
+ *
+ * A reader announces the global epoch in its own (cache-line sized) record while it is inside an
+ * EpochGuard. A writer that unlinked an object hands it to retire(); it is only freed once the
+ * global epoch moved two steps further, i.e. after every reader that could still see it has left.
+ * The global epoch only advances when all active readers announced the current one.
+ *
+ * Records are claimed by threads on first use and handed back when the thread exits, so the
+ * short-lived pthreads of the benchmarks reuse them. They are never freed.
+ */
+class EpochDomain {
+private:
+    static constexpr uint64_t IDLE = ~0ULL;
+    static constexpr int BAG_COUNT = 3;
+
+    struct Retired {
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    struct alignas(64) ThreadRecord {
+        atomic<uint64_t> localEpoch{IDLE};
+        atomic<bool> inUse{false};
+        ThreadRecord* nextRecord = nullptr;
+        int nesting = 0;
+        uint64_t retiredSinceScan = 0;
+        uint64_t bagEpoch[BAG_COUNT] = {0, 0, 0};
+        vector<Retired> bags[BAG_COUNT];
+    };
+
+    // releases the record of a thread when it exits
+    struct RecordOwner {
+        ThreadRecord* record = nullptr;
+        ~RecordOwner() {
+            if (record) {
+                record->localEpoch.store(IDLE, memory_order_release);
+                record->inUse.store(false, memory_order_release);
+            }
+        }
+    };
+
+    alignas(64) atomic<uint64_t> globalEpoch{1};
+    alignas(64) atomic<ThreadRecord*> records{nullptr};
+
+    ThreadRecord* acquireRecord() {
+        for (ThreadRecord* r = records.load(memory_order_acquire); r; r = r->nextRecord) {
+            bool expected = false;
+            if (!r->inUse.load(memory_order_relaxed) && r->inUse.compare_exchange_strong(expected, true)) {
+                return r;
+            }
+        }
+        ThreadRecord* r = new ThreadRecord();
+        r->inUse.store(true, memory_order_relaxed);
+        ThreadRecord* head = records.load(memory_order_relaxed);
+        do {
+            r->nextRecord = head;
+        } while (!records.compare_exchange_weak(head, r, memory_order_release, memory_order_relaxed));
+        return r;
+    }
+
+    ThreadRecord* myRecord() {
+        static thread_local RecordOwner owner;
+        if (!owner.record) {
+            owner.record = acquireRecord();
+        }
+        return owner.record;
+    }
+
+    static void freeBag(vector<Retired>& bag) {
+        for (Retired& r : bag) {
+            r.deleter(r.object);
+        }
+        bag.clear();
+    }
+
+    // the epoch moves on only if every thread inside a guard has seen the current one
+    void tryAdvance(uint64_t epoch) {
+        for (ThreadRecord* r = records.load(memory_order_acquire); r; r = r->nextRecord) {
+            uint64_t local = r->localEpoch.load(memory_order_seq_cst);
+            if (local != IDLE && local != epoch) {
+                return;
+            }
+        }
+        globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+    }
+
+public:
+    static EpochDomain& instance() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    void enter() {
+        ThreadRecord* r = myRecord();
+        if (r->nesting++ == 0) {
+            // seq_cst store: later loads of shared pointers cannot move before the announcement
+            r->localEpoch.store(globalEpoch.load(memory_order_acquire), memory_order_seq_cst);
+        }
+    }
+
+    void exit() {
+        ThreadRecord* r = myRecord();
+        if (--r->nesting == 0) {
+            r->localEpoch.store(IDLE, memory_order_release);
+        }
+    }
+
+    /**
+     * Frees 'object' with 'deleter' once no reader can reach it any more.
+     * The object must already be unlinked from every shared structure.
+     */
+    void retire(void* object, void (*deleter)(void*)) {
+        ThreadRecord* r = myRecord();
+        uint64_t epoch = globalEpoch.load(memory_order_seq_cst);
+        int bag = epoch % BAG_COUNT;
+        if (r->bagEpoch[bag] != epoch) {
+            // this bag was filled at least three epochs ago, nobody can still hold its objects
+            freeBag(r->bags[bag]);
+            r->bagEpoch[bag] = epoch;
+        }
+        r->bags[bag].push_back(Retired{object, deleter});
+
+        if (++r->retiredSinceScan >= EPOCH_SCAN_THRESHOLD) {
+            r->retiredSinceScan = 0;
+            tryAdvance(epoch);
+        }
+    }
+
+    template <typename T>
+    void retire(T* object) {
+        retire(object, [](void* p) { delete static_cast<T*>(p); });
+    }
+};
+
+// keeps the calling thread inside an epoch for its scope
+class EpochGuard {
+public:
+    EpochGuard() {
+        EpochDomain::instance().enter();
+    }
+    ~EpochGuard() {
+        EpochDomain::instance().exit();
+    }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+#endif
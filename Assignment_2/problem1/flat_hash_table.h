@@ -0,0 +1,320 @@
+#ifndef FLAT_HASH_TABLE_H
+#define FLAT_HASH_TABLE_H
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "concurrent_hash_table.h"
+#include "cpu_hints.h"
+
+using namespace std;
+
+// live entries per slot the table is sized (and grown) for
+#define FLAT_MAX_LOAD_FACTOR 0.5
+// live plus deleted entries per slot at which the table is rehashed
+#define FLAT_MAX_FILL 0.75
+// writer locks, selected by the top bits of the key hash (power of two)
+#define FLAT_WRITER_STRIPES 64
+
+/**
+ * Open-addressing variant of ConcurrentHashTable.
+ *
+ * KeyValue pairs are stored inline in one flat, cache-line-aligned array (8 slots per line) and
+ * found by linear probing, so a lookup touches one or two consecutive lines instead of a chain
+ * of separately allocated nodes. Each slot is a single 64-bit word {key, value}.
+ *  - lookup only loads words and never writes shared memory (nor takes a lock),
+ *  - insert and deleteKey lock the writer stripe of their key, so all writes of one key are
+ *    serialized: an insert can reuse the first tombstone on the probe path once it has seen that
+ *    the key is not further along, and a slot holding a key only changes under its stripe lock.
+ *    Claiming an empty slot or a tombstone still needs a CAS, inserts of other stripes race for it.
+ *
+ * Slots only become empty again by rehashing: every stripe counts the empty slots its inserts
+ * used up, and a stripe that reaches its share of FLAT_MAX_FILL takes all stripe locks and copies
+ * the live entries into a new array (twice the size if they exceed FLAT_MAX_LOAD_FACTOR). The old
+ * array is freed through the epoch domain, lookups still probing it are inside an EpochGuard.
+ *
+ * insert keeps keys unique (it overwrites the value of a present key, like
+ * ConcurrentHashTable::upsert), while ConcurrentHashTable::insert adds a duplicate node. This is
+ * intended: a slot holds exactly one key. Two key values are reserved as markers.
+ */
+class FlatConcurrentHashTable {
+public:
+    static constexpr uint32_t EMPTY_KEY = 0xFFFFFFFFu;
+    static constexpr uint32_t TOMBSTONE_KEY = 0xFFFFFFFEu;
+
+private:
+    static constexpr uint64_t EMPTY_WORD = ~0ULL;
+    static constexpr uint64_t TOMBSTONE_WORD = (uint64_t)TOMBSTONE_KEY << 32;
+    static constexpr int STRIPE_SHIFT = 64 - __builtin_ctz(FLAT_WRITER_STRIPES);
+    // at least 8 slots per stripe, so that every stripe gets a budget
+    static constexpr uint64_t MIN_CAPACITY = 8 * FLAT_WRITER_STRIPES;
+
+    struct SlotArray {
+        atomic<uint64_t>* slots;
+        uint64_t capacity;
+        uint64_t mask;
+        int shift;
+        uint64_t stripeBudget;    // empty slots one stripe may use up before a rehash
+
+        explicit SlotArray(uint64_t capacity) : capacity(capacity), mask(capacity - 1) {
+            shift = 64 - __builtin_ctzll(capacity);
+            stripeBudget = (uint64_t)(capacity * FLAT_MAX_FILL) / FLAT_WRITER_STRIPES;
+            void* memory = aligned_alloc(CACHE_LINE_SIZE, capacity * sizeof(atomic<uint64_t>));
+            if (!memory) {
+                throw bad_alloc();
+            }
+            slots = static_cast<atomic<uint64_t>*>(memory);
+            for (uint64_t i = 0; i < capacity; i++) {
+                new (&slots[i]) atomic<uint64_t>(EMPTY_WORD);
+            }
+        }
+
+        ~SlotArray() {
+            free(slots);
+        }
+
+        // Fibonacci hashing (top bits of the product), consecutive keys end up far apart
+        uint64_t home(uint32_t key) const {
+            return (key * 0x9E3779B97F4A7C15ULL) >> shift;
+        }
+    };
+
+    struct alignas(CACHE_LINE_SIZE) WriterStripe {
+        pthread_mutex_t lock;
+        uint64_t claimed;    // empty slots turned into entries by this stripe since the last rehash
+    };
+
+    atomic<SlotArray*> current;
+    WriterStripe stripes[FLAT_WRITER_STRIPES];
+
+    static uint64_t pack(uint32_t key, uint32_t value) {
+        return ((uint64_t)key << 32) | value;
+    }
+
+    static uint32_t keyOf(uint64_t word) {
+        return (uint32_t)(word >> 32);
+    }
+
+    static uint32_t stripeOf(uint32_t key) {
+        return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> STRIPE_SHIFT);
+    }
+
+    static uint64_t capacityFor(uint64_t entries) {
+        uint64_t needed = (uint64_t)(entries / FLAT_MAX_LOAD_FACTOR) + 1;
+        uint64_t capacity = MIN_CAPACITY;
+        while (capacity < needed) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    static void deleteArray(void* array) {
+        delete static_cast<SlotArray*>(array);
+    }
+
+    /**
+     * Insert body, the caller holds the stripe lock of the key. Returns false only if neither an
+     * empty slot nor a tombstone is left on the whole probe path.
+     */
+    bool insertLocked(SlotArray* array, uint32_t key, uint64_t desired, WriterStripe& stripe) {
+        while (true) {
+            uint64_t idx = array->home(key);
+            uint64_t tombstone = array->capacity;
+            uint64_t empty = array->capacity;
+            for (uint64_t probes = 0; probes < array->capacity; probes++) {
+                uint64_t word = array->slots[idx].load(memory_order_acquire);
+                if (keyOf(word) == key) {
+                    // no other thread writes this slot while we hold the stripe
+                    array->slots[idx].store(desired, memory_order_release);
+                    return true;
+                }
+                if (word == EMPTY_WORD) {
+                    empty = idx;
+                    break;
+                }
+                if (word == TOMBSTONE_WORD && tombstone == array->capacity) {
+                    tombstone = idx;
+                }
+                idx = (idx + 1) & array->mask;
+            }
+
+            // the key is absent: take the first tombstone, else the empty slot that ended the probe
+            uint64_t target = tombstone != array->capacity ? tombstone : empty;
+            if (target == array->capacity) {
+                return false;
+            }
+            uint64_t expected = target == tombstone ? TOMBSTONE_WORD : EMPTY_WORD;
+            if (array->slots[target].compare_exchange_strong(expected, desired, memory_order_acq_rel,
+                                                             memory_order_relaxed)) {
+                if (target == empty) {
+                    stripe.claimed++;
+                }
+                return true;
+            }
+            // an insert of another stripe took the slot, probe again
+        }
+    }
+
+    /**
+     * Replaces 'seen' by a new array holding only the live entries, unless another thread already
+     * did. Takes every stripe lock; the caller holds none.
+     */
+    void rehash(SlotArray* seen) {
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_lock(&stripe.lock);
+        }
+        SlotArray* old = current.load(memory_order_relaxed);
+        if (old == seen) {
+            uint64_t live = 0;
+            uint64_t stripeLive[FLAT_WRITER_STRIPES] = {0};
+            for (uint64_t i = 0; i < old->capacity; i++) {
+                uint64_t word = old->slots[i].load(memory_order_relaxed);
+                if (word != EMPTY_WORD && word != TOMBSTONE_WORD) {
+                    live++;
+                    stripeLive[stripeOf(keyOf(word))]++;
+                }
+            }
+            uint64_t busiestStripe = *max_element(stripeLive, stripeLive + FLAT_WRITER_STRIPES);
+
+            // leave every stripe at least half of its budget
+            uint64_t capacity = max(old->capacity, capacityFor(live));
+            while (busiestStripe * 2 > (uint64_t)(capacity * FLAT_MAX_FILL) / FLAT_WRITER_STRIPES) {
+                capacity <<= 1;
+            }
+
+            SlotArray* fresh = new SlotArray(capacity);
+            for (uint64_t i = 0; i < old->capacity; i++) {
+                uint64_t word = old->slots[i].load(memory_order_relaxed);
+                if (word == EMPTY_WORD || word == TOMBSTONE_WORD) {
+                    continue;
+                }
+                uint64_t idx = fresh->home(keyOf(word));
+                while (fresh->slots[idx].load(memory_order_relaxed) != EMPTY_WORD) {
+                    idx = (idx + 1) & fresh->mask;
+                }
+                fresh->slots[idx].store(word, memory_order_relaxed);
+            }
+            for (int s = 0; s < FLAT_WRITER_STRIPES; s++) {
+                stripes[s].claimed = stripeLive[s];
+            }
+            current.store(fresh, memory_order_release);
+            EpochDomain::instance().retire(old, deleteArray);
+        }
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_unlock(&stripe.lock);
+        }
+    }
+
+public:
+    FlatConcurrentHashTable(uint64_t expectedEntries = INITIAL_BUCKET_COUNT) {
+        current.store(new SlotArray(capacityFor(expectedEntries)), memory_order_relaxed);
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_init(&stripe.lock, nullptr);
+            stripe.claimed = 0;
+        }
+    }
+
+    ~FlatConcurrentHashTable() {
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_destroy(&stripe.lock);
+        }
+        delete current.load(memory_order_relaxed);
+    }
+
+    FlatConcurrentHashTable(const FlatConcurrentHashTable&) = delete;
+    FlatConcurrentHashTable& operator=(const FlatConcurrentHashTable&) = delete;
+
+    /**
+     * Inserts kv, or overwrites the value if the key is already present.
+     * Returns false if the key is one of the two reserved markers.
+     */
+    bool insert(KeyValue kv) {
+        if (kv.key == EMPTY_KEY || kv.key == TOMBSTONE_KEY) {
+            return false;
+        }
+        uint64_t desired = pack(kv.key, kv.value);
+        WriterStripe& stripe = stripes[stripeOf(kv.key)];
+
+        while (true) {
+            pthread_mutex_lock(&stripe.lock);
+            SlotArray* array = current.load(memory_order_acquire);
+            if (stripe.claimed < array->stripeBudget && insertLocked(array, kv.key, desired, stripe)) {
+                pthread_mutex_unlock(&stripe.lock);
+                return true;
+            }
+            pthread_mutex_unlock(&stripe.lock);
+            rehash(array);
+        }
+    }
+
+    bool deleteKey(uint32_t key) {
+        if (key == EMPTY_KEY || key == TOMBSTONE_KEY) {
+            return false;
+        }
+        WriterStripe& stripe = stripes[stripeOf(key)];
+        pthread_mutex_lock(&stripe.lock);
+        SlotArray* array = current.load(memory_order_acquire);
+        uint64_t idx = array->home(key);
+        bool deleted = false;
+
+        for (uint64_t probes = 0; probes < array->capacity; probes++) {
+            uint64_t word = array->slots[idx].load(memory_order_acquire);
+            if (word == EMPTY_WORD) {
+                break;
+            }
+            if (keyOf(word) == key) {
+                array->slots[idx].store(TOMBSTONE_WORD, memory_order_release);
+                deleted = true;
+                break;
+            }
+            idx = (idx + 1) & array->mask;
+        }
+        pthread_mutex_unlock(&stripe.lock);
+        return deleted;
+    }
+
+    bool lookup(uint32_t key, uint32_t &value) {
+        if (key == EMPTY_KEY || key == TOMBSTONE_KEY) {
+            return false;
+        }
+        EpochGuard guard;
+        SlotArray* array = current.load(memory_order_acquire);
+        uint64_t idx = array->home(key);
+
+        for (uint64_t probes = 0; probes < array->capacity; probes++) {
+            uint64_t word = array->slots[idx].load(memory_order_acquire);
+            if (word == EMPTY_WORD) {
+                return false;
+            }
+            if (keyOf(word) == key) {
+                value = (uint32_t)word;
+                return true;
+            }
+            idx = (idx + 1) & array->mask;
+        }
+        return false;
+    }
+
+    uint64_t getCapacity() const {
+        return current.load(memory_order_acquire)->capacity;
+    }
+
+    // not safe against a concurrent rehash
+    void printTableContents() {
+        SlotArray* array = current.load(memory_order_acquire);
+        for (uint64_t i = 0; i < array->capacity; i++) {
+            uint64_t word = array->slots[i].load(memory_order_acquire);
+            if (word != EMPTY_WORD && word != TOMBSTONE_WORD) {
+                cout << "Key: " << keyOf(word) << " Value: " << (uint32_t)word << endl;
+            }
+        }
+    }
+};
+
+#endif
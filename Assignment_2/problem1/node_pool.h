@@ -0,0 +1,227 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+// slabs are aligned to their size, so the owning pool of any node is found by masking its address
+#define NODE_SLAB_BYTES (64 * 1024)
+// nodes freed by a foreign thread are sent back to their owner in chains of this length
+#define REMOTE_FREE_BATCH 64
+
+struct PoolStats {
+    uint64_t slabs;
+    int64_t liveNodes;
+    uint64_t remoteFrees;
+};
+
+/**
+ * Per-thread slab allocator for fixed-size nodes (one instance family per node type T).
+ *
+ * Every thread owns a pool and allocates from it without any synchronization. A node freed by
+ * its owner goes straight back to the owner's free list. A node freed by another thread (for
+ * example by the epoch reclamation of a lookup-heavy thread) is collected in a per-owner batch
+ * and the whole batch is pushed onto the owner's remote list with a single CAS; the owner takes
+ * that list over with one exchange when its local list runs dry.
+ *
+ * When a thread exits its pool is flushed and released, the next new thread adopts it together
+ * with its slabs. Slabs are only returned to the system at process exit.
+ */
+template <typename T>
+class NodePool {
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct SlabHeader {
+        NodePool* owner;
+    };
+
+    struct OutgoingBatch {
+        NodePool* owner;
+        FreeNode* head;
+        FreeNode* tail;
+        uint32_t count;
+    };
+
+    static constexpr size_t SLOT_SIZE = sizeof(T) > sizeof(FreeNode) ? sizeof(T) : sizeof(FreeNode);
+    static constexpr size_t SLOT_ALIGN = alignof(T) > alignof(FreeNode) ? alignof(T) : alignof(FreeNode);
+    static constexpr size_t SLOT_STRIDE = (SLOT_SIZE + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+    static constexpr size_t FIRST_SLOT = (sizeof(SlabHeader) + SLOT_STRIDE - 1) / SLOT_STRIDE * SLOT_STRIDE;
+
+    // owner-only state
+    FreeNode* localFree = nullptr;
+    vector<void*> slabs;
+    vector<OutgoingBatch> outgoing;
+
+    // shared state
+    alignas(64) atomic<FreeNode*> remoteFree{nullptr};
+    atomic<bool> inUse{false};
+    NodePool* nextPool = nullptr;
+
+    // statistics, each counter is only written by the thread owning this pool
+    alignas(64) atomic<uint64_t> slabCount{0};
+    atomic<uint64_t> allocatedNodes{0};
+    atomic<uint64_t> freedNodes{0};
+    atomic<uint64_t> remoteFrees{0};
+
+    static inline atomic<NodePool*> pools{nullptr};
+
+    struct PoolOwner {
+        NodePool* pool = nullptr;
+        ~PoolOwner() {
+            if (pool) {
+                pool->flushOutgoing();
+                pool->inUse.store(false, memory_order_release);
+            }
+        }
+    };
+
+    static NodePool* acquirePool() {
+        for (NodePool* p = pools.load(memory_order_acquire); p; p = p->nextPool) {
+            bool expected = false;
+            if (!p->inUse.load(memory_order_relaxed) && p->inUse.compare_exchange_strong(expected, true)) {
+                return p;
+            }
+        }
+        NodePool* p = new NodePool();
+        p->inUse.store(true, memory_order_relaxed);
+        NodePool* head = pools.load(memory_order_relaxed);
+        do {
+            p->nextPool = head;
+        } while (!pools.compare_exchange_weak(head, p, memory_order_release, memory_order_relaxed));
+        return p;
+    }
+
+    static NodePool* myPool() {
+        static thread_local PoolOwner owner;
+        if (!owner.pool) {
+            owner.pool = acquirePool();
+        }
+        return owner.pool;
+    }
+
+    static NodePool* ownerOf(void* node) {
+        uintptr_t slab = reinterpret_cast<uintptr_t>(node) & ~(uintptr_t)(NODE_SLAB_BYTES - 1);
+        return reinterpret_cast<SlabHeader*>(slab)->owner;
+    }
+
+    void addSlab() {
+        void* memory = aligned_alloc(NODE_SLAB_BYTES, NODE_SLAB_BYTES);
+        if (!memory) {
+            throw bad_alloc();
+        }
+        reinterpret_cast<SlabHeader*>(memory)->owner = this;
+        slabs.push_back(memory);
+        slabCount.fetch_add(1, memory_order_relaxed);
+
+        char* base = static_cast<char*>(memory);
+        for (size_t offset = NODE_SLAB_BYTES - SLOT_STRIDE; offset >= FIRST_SLOT; offset -= SLOT_STRIDE) {
+            FreeNode* slot = reinterpret_cast<FreeNode*>(base + offset);
+            slot->next = localFree;
+            localFree = slot;
+        }
+    }
+
+    void pushRemote(FreeNode* head, FreeNode* tail) {
+        FreeNode* top = remoteFree.load(memory_order_relaxed);
+        do {
+            tail->next = top;
+        } while (!remoteFree.compare_exchange_weak(top, head, memory_order_release, memory_order_relaxed));
+    }
+
+    void flushOutgoing() {
+        for (OutgoingBatch& batch : outgoing) {
+            if (batch.count > 0) {
+                batch.owner->pushRemote(batch.head, batch.tail);
+                remoteFrees.fetch_add(batch.count, memory_order_relaxed);
+                batch.head = batch.tail = nullptr;
+                batch.count = 0;
+            }
+        }
+    }
+
+    void* take() {
+        if (!localFree) {
+            localFree = remoteFree.exchange(nullptr, memory_order_acquire);
+            if (!localFree) {
+                addSlab();
+            }
+        }
+        FreeNode* slot = localFree;
+        localFree = slot->next;
+        allocatedNodes.store(allocatedNodes.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return slot;
+    }
+
+    void give(void* memory) {
+        NodePool* owner = ownerOf(memory);
+        FreeNode* slot = static_cast<FreeNode*>(memory);
+        freedNodes.store(freedNodes.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        if (owner == this) {
+            slot->next = localFree;
+            localFree = slot;
+            return;
+        }
+
+        OutgoingBatch* batch = nullptr;
+        for (OutgoingBatch& b : outgoing) {
+            if (b.owner == owner) {
+                batch = &b;
+                break;
+            }
+        }
+        if (!batch) {
+            outgoing.push_back(OutgoingBatch{owner, nullptr, nullptr, 0});
+            batch = &outgoing.back();
+        }
+        slot->next = batch->head;
+        batch->head = slot;
+        if (!batch->tail) {
+            batch->tail = slot;
+        }
+        if (++batch->count == REMOTE_FREE_BATCH) {
+            owner->pushRemote(batch->head, batch->tail);
+            remoteFrees.fetch_add(batch->count, memory_order_relaxed);
+            batch->head = batch->tail = nullptr;
+            batch->count = 0;
+        }
+    }
+
+public:
+    template <typename... Args>
+    static T* create(Args&&... args) {
+        void* memory = myPool()->take();
+        return new (memory) T{std::forward<Args>(args)...};
+    }
+
+    static void destroy(T* node) {
+        node->~T();
+        myPool()->give(node);
+    }
+
+    // deleter usable with EpochDomain::retire
+    static void destroyErased(void* node) {
+        destroy(static_cast<T*>(node));
+    }
+
+    // totals over all pools of this node type (approximate while threads are running)
+    static PoolStats stats() {
+        PoolStats total = {0, 0, 0};
+        for (NodePool* p = pools.load(memory_order_acquire); p; p = p->nextPool) {
+            total.slabs += p->slabCount.load(memory_order_relaxed);
+            total.liveNodes += (int64_t)(p->allocatedNodes.load(memory_order_relaxed) -
+                                         p->freedNodes.load(memory_order_relaxed));
+            total.remoteFrees += p->remoteFrees.load(memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+#endif
@@ -8,10 +8,18 @@
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
+#include <type_traits>
+#include <vector>
 
+#include "concurrent_cache.h"
 #include "concurrent_hash_table.h"
+#include "flat_hash_table.h"
+#include "sharded_hash_table.h"
+#include "swiss_hash_table.h"
+#include "workload.h"
 
 using namespace std;
 
@@ -23,14 +31,35 @@ using namespace filesystem;
 static constexpr uint64_t SEED = 42;
 static const uint32_t BUCKET_COUNT = 1000;
 static constexpr uint64_t MAX_OPS = 1e+15;
+// threads, lock/unlock rounds per thread and seconds until a hang counts as a lost wake-up (-lkt)
+static constexpr int LOCK_TEST_THREADS = 8;
+static constexpr int LOCK_TEST_ROUNDS = 20000;
+static constexpr int LOCK_TEST_TIMEOUT_S = 60;
 
 uint64_t totalOperations = 1e8;
 uint64_t insertPercentage = 100;
 uint64_t deletePercentage = 0;
 uint64_t runCount = 2;
 bool isUnitTestEnabled = false;
-
+bool isCompareEnabled = false;
+bool isBulkEnabled = false;
+bool isMixEnabled = false;
+bool isCsvEnabled = false;
+bool isNumaEnabled = false;
+bool isBulkLoadEnabled = false;
+bool isImageEnabled = false;
+bool isCacheEnabled = false;
+bool isFilterEnabled = false;
+bool isLockTestEnabled = false;
+BucketLockMode bucketLockMode = LOCK_PTHREAD;
+double zipfTheta = 0.99;
+
+using UIntHashTable = ConcurrentHashTable<uint32_t, uint32_t>;
+using UIntShardedTable = ShardedHashTable<uint32_t, uint32_t>;
+
+// one per thread, they must stay alive until the thread is joined
 struct ThreadArgs {
+    UIntHashTable* table;
     void* data;
     uint64_t operationCount;
 };
@@ -58,6 +87,39 @@ int parseArguments(char* argument) {
         insertPercentage = value;
     } else if (flag == "-rem") {
         deletePercentage = value;
+    } else if (flag == "-cmp") {
+        isCompareEnabled = value != 0;
+    } else if (flag == "-blk") {
+        isBulkEnabled = value != 0;
+    } else if (flag == "-mix") {
+        isMixEnabled = value != 0;
+    } else if (flag == "-lck") {
+        // 0: pthread mutex per bucket, 1: lock bits embedded in the bucket head word
+        bucketLockMode = value != 0 ? LOCK_EMBEDDED : LOCK_PTHREAD;
+    } else if (flag == "-bld") {
+        // builds the table of each round with the parallel bulk-load constructor instead of the insert phase
+        isBulkLoadEnabled = value != 0;
+    } else if (flag == "-cch") {
+        isCacheEnabled = value != 0;
+    } else if (flag == "-img") {
+        isImageEnabled = value != 0;
+    } else if (flag == "-flt") {
+        // per-bucket negative filter in front of the chains
+        isFilterEnabled = value != 0;
+    } else if (flag == "-lkt") {
+        // contention test of the embedded bucket lock, then exit
+        isLockTestEnabled = value != 0;
+    } else if (flag == "-nma") {
+        isNumaEnabled = value != 0;
+    } else if (flag == "-csv") {
+        isCsvEnabled = value != 0;
+    } else if (flag == "-zth") {
+        // Zipf exponent in hundredths, e.g. -zth=99 for 0.99
+        if (value == 100) {
+            cout << "Zipf exponent 1.00 is not supported\n";
+            return 1;
+        }
+        zipfTheta = value / 100.0;
     } else if (flag == "-test") {
         isUnitTestEnabled = true;
     } else {
@@ -81,14 +143,52 @@ void readDataFromFile(path filePath, uint64_t size, uint32_t* data) {
     fclose(file);
 }
 
+/**
+ * Reads 'size' keys and 'size' values straight into the pairs, a block of each file at a time,
+ * so that no full-size key or value array is needed besides the pairs themselves.
+ */
+void readKeyValuesFromFiles(path keysPath, path valuesPath, uint64_t size, KeyValue* data) {
+    static constexpr uint64_t BLOCK = 1 << 16;
+    FILE* keysFile = fopen(keysPath.string().c_str(), "rb");
+    FILE* valuesFile = fopen(valuesPath.string().c_str(), "rb");
+    if (!keysFile || !valuesFile) {
+        perror(("Unable to open file: " + (keysFile ? valuesPath : keysPath).string()).c_str());
+        exit(EXIT_FAILURE);
+    }
+    vector<uint32_t> keys(BLOCK);
+    vector<uint32_t> values(BLOCK);
+    for (uint64_t base = 0; base < size; base += BLOCK) {
+        uint64_t n = min(BLOCK, size - base);
+        size_t keyCount = fread(keys.data(), sizeof(uint32_t), n, keysFile);
+        size_t valueCount = fread(values.data(), sizeof(uint32_t), n, valuesFile);
+        if (keyCount == 0 || valueCount == 0) {
+            if (base == 0) {
+                perror(("Unable to read the file " + (keyCount ? valuesPath : keysPath).string()).c_str());
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        for (uint64_t i = 0; i < min(keyCount, valueCount); i++) {
+            data[base + i].key = keys[i];
+            data[base + i].value = values[i];
+        }
+    }
+    fclose(keysFile);
+    fclose(valuesFile);
+}
+
 void* insertBatch(void* args) {
     ThreadArgs* data = static_cast<ThreadArgs*>(args);
     KeyValue* keyValues = static_cast<KeyValue*>(data->data);
-    ConcurrentHashTable table;
+    UIntHashTable& table = *data->table;
 
     auto start = HR::now();
-    for (uint64_t i = 0; i < data->operationCount; i++) {
-        table.insert(keyValues[i]);
+    if (isBulkEnabled) {
+        table.insertMany(keyValues, data->operationCount);
+    } else {
+        for (uint64_t i = 0; i < data->operationCount; i++) {
+            table.insert(keyValues[i]);
+        }
     }
     auto end = HR::now();
     return new long(duration_cast<milliseconds>(end - start).count());
@@ -97,11 +197,15 @@ void* insertBatch(void* args) {
 void* deleteBatch(void* args) {
     ThreadArgs* data = static_cast<ThreadArgs*>(args);
     uint32_t* keys = static_cast<uint32_t*>(data->data);
-    ConcurrentHashTable table;
+    UIntHashTable& table = *data->table;
 
     auto start = HR::now();
-    for (uint64_t i = 0; i < data->operationCount; i++) {
-        table.deleteKey(keys[i]);
+    if (isBulkEnabled) {
+        table.deleteMany(keys, data->operationCount);
+    } else {
+        for (uint64_t i = 0; i < data->operationCount; i++) {
+            table.deleteKey(keys[i]);
+        }
     }
     auto end = HR::now();
     return new long(duration_cast<milliseconds>(end - start).count());
@@ -110,17 +214,534 @@ void* deleteBatch(void* args) {
 void* searchBatch(void* args) {
     ThreadArgs* data = static_cast<ThreadArgs*>(args);
     uint32_t* keys = static_cast<uint32_t*>(data->data);
-    ConcurrentHashTable table;
+    UIntHashTable& table = *data->table;
+    uint32_t value;
+    vector<uint32_t> values(isBulkEnabled ? data->operationCount : 0);
+    unique_ptr<bool[]> found(new bool[isBulkEnabled ? data->operationCount : 0]);
+
+    auto start = HR::now();
+    if (isBulkEnabled) {
+        table.lookupMany(keys, data->operationCount, values.data(), found.get());
+    } else {
+        for (uint64_t i = 0; i < data->operationCount; i++) {
+            table.lookup(keys[i], value);
+        }
+    }
+    auto end = HR::now();
+    return new long(duration_cast<milliseconds>(end - start).count());
+}
+
+// runs 'worker' on numThreads threads, each on its own slice of items; returns the summed thread times (ms)
+template <typename Item>
+long runPhase(void* (*worker)(void*), UIntHashTable* table, Item* items, uint64_t count, int numThreads) {
+    uint64_t perThread = count / numThreads;
+    vector<pthread_t> threads(numThreads);
+    vector<ThreadArgs> args(numThreads);
+    long totalTime = 0;
+
+    for (int i = 0; i < numThreads; i++) {
+        uint64_t n = (i == numThreads - 1) ? count - i * perThread : perThread;
+        args[i] = ThreadArgs{table, items + i * perThread, n};
+        pthread_create(&threads[i], nullptr, worker, &args[i]);
+    }
+    for (int i = 0; i < numThreads; i++) {
+        void* result;
+        pthread_join(threads[i], &result);
+        totalTime += *(long*)result;
+        delete (long*)result;
+    }
+    return totalTime;
+}
+
+// -cmp=1: chained vs open addressing vs bucketized (swiss) table. All threads of a round share one table,
+// which is sized up front for all inserts so that neither variant has to grow.
+// With -blk=1 the chained table runs its prefetching bulk operations.
+enum ComparePhase { PHASE_INSERT, PHASE_SEARCH, PHASE_DELETE };
+
+template <typename Table>
+struct CompareArgs {
+    Table* table;
+    void* data;
+    uint64_t operationCount;
+    uint64_t failedInserts;    // inserts that returned false (tables whose insert can fail)
+};
+
+template <typename Table, ComparePhase phase>
+void* compareBatch(void* args) {
+    CompareArgs<Table>* data = static_cast<CompareArgs<Table>*>(args);
     uint32_t value;
+    constexpr bool hasBulk = is_same<Table, UIntHashTable>::value;
+    vector<uint32_t> values(hasBulk && phase == PHASE_SEARCH ? data->operationCount : 0);
+    unique_ptr<bool[]> found(new bool[values.size()]);
 
     auto start = HR::now();
+    if constexpr (hasBulk) {
+        if (isBulkEnabled) {
+            if (phase == PHASE_INSERT) {
+                data->table->insertMany(static_cast<KeyValue*>(data->data), data->operationCount);
+            } else if (phase == PHASE_SEARCH) {
+                data->table->lookupMany(static_cast<uint32_t*>(data->data), data->operationCount, values.data(),
+                                        found.get());
+            } else {
+                data->table->deleteMany(static_cast<uint32_t*>(data->data), data->operationCount);
+            }
+            auto end = HR::now();
+            return new long(duration_cast<milliseconds>(end - start).count());
+        }
+    }
     for (uint64_t i = 0; i < data->operationCount; i++) {
-        table.lookup(keys[i], value);
+        if (phase == PHASE_INSERT) {
+            if constexpr (is_same<decltype(data->table->insert(KeyValue())), bool>::value) {
+                data->failedInserts += !data->table->insert(static_cast<KeyValue*>(data->data)[i]);
+            } else {
+                data->table->insert(static_cast<KeyValue*>(data->data)[i]);
+            }
+        } else if (phase == PHASE_SEARCH) {
+            data->table->lookup(static_cast<uint32_t*>(data->data)[i], value);
+        } else {
+            data->table->deleteKey(static_cast<uint32_t*>(data->data)[i]);
+        }
     }
     auto end = HR::now();
     return new long(duration_cast<milliseconds>(end - start).count());
 }
 
+// runs one phase with numThreads threads on the shared table, returns the wall time in ms
+template <typename Table, ComparePhase phase, typename Item>
+long runComparePhase(Table* table, Item* items, uint64_t count, int numThreads, uint64_t* failedInserts = nullptr) {
+    uint64_t perThread = count / numThreads;
+    vector<pthread_t> threads(numThreads);
+    vector<CompareArgs<Table>> args(numThreads);
+
+    auto start = HR::now();
+    for (int i = 0; i < numThreads; i++) {
+        uint64_t n = (i == numThreads - 1) ? count - i * perThread : perThread;
+        args[i] = CompareArgs<Table>{table, items + i * perThread, n, 0};
+        pthread_create(&threads[i], nullptr, compareBatch<Table, phase>, &args[i]);
+    }
+    for (int i = 0; i < numThreads; i++) {
+        void* result;
+        pthread_join(threads[i], &result);
+        delete (long*)result;
+        if (failedInserts) {
+            *failedInserts += args[i].failedInserts;
+        }
+    }
+    auto end = HR::now();
+    return duration_cast<milliseconds>(end - start).count();
+}
+
+void printAllocatorStats() {
+    PoolStats stats = UIntHashTable::allocatorStats();
+    cout << "Node pools: slabs=" << stats.slabs << " live nodes=" << stats.liveNodes
+         << " remote frees=" << stats.remoteFrees << "\n";
+}
+
+void printFilterStats(UIntHashTable* table) {
+    FilterStats stats = table->filterStats();
+    cout << "Negative filter: rejected misses=" << stats.rejects << " false positives=" << stats.falsePositives
+         << "\n";
+}
+
+static double mops(uint64_t ops, long ms) {
+    return ms > 0 ? ops / (ms * 1000.0) : 0.0;
+}
+
+template <typename Table>
+void runComparison(const string& name, Table* table, KeyValue* insertData, uint64_t adds, uint32_t* searchKeys,
+                   uint64_t finds, uint32_t* deleteKeys, uint64_t removes, int numThreads) {
+    uint64_t failedInserts = 0;
+    long insertMs = runComparePhase<Table, PHASE_INSERT>(table, insertData, adds, numThreads, &failedInserts);
+    long searchMs = runComparePhase<Table, PHASE_SEARCH>(table, searchKeys, finds, numThreads);
+    long deleteMs = runComparePhase<Table, PHASE_DELETE>(table, deleteKeys, removes, numThreads);
+
+    cout << name << " threads=" << numThreads << " insert(ms)=" << insertMs << " [" << mops(adds, insertMs)
+         << " Mops/s] search(ms)=" << searchMs << " [" << mops(finds, searchMs) << " Mops/s] delete(ms)=" << deleteMs
+         << " [" << mops(removes, deleteMs) << " Mops/s]\n";
+    if (failedInserts > 0) {
+        cout << name << " FAILED inserts=" << failedInserts << " of " << adds << "\n";
+    }
+}
+
+/**
+ * -mix=1: all threads run a mix of upserts, deletes and lookups (-add / -rem percentages, the rest
+ * lookups) at the same time on one table that was filled with all insert keys beforehand. Keys are
+ * drawn from the insert keys, uniformly or Zipf distributed (-zth). Upserts keep the keys unique,
+ * so chains do not grow over the run. Every thread has its own random engine and latency
+ * histogram; each operation is timed individually.
+ */
+enum KeyDistribution { DIST_UNIFORM, DIST_ZIPF };
+
+struct MixArgs {
+    UIntHashTable* table;
+    const KeyValue* keys;
+    uint64_t keyCount;
+    uint64_t operationCount;
+    KeyDistribution distribution;
+    const ZipfGenerator* zipf;
+    uint64_t seed;
+    pthread_barrier_t* startBarrier;
+    LatencyHistogram histogram;
+    long elapsedNs;
+};
+
+void* mixedBatch(void* args) {
+    MixArgs* data = static_cast<MixArgs*>(args);
+    mt19937_64 engine(data->seed);
+    uniform_int_distribution<uint64_t> uniformKey(0, data->keyCount - 1);
+    uniform_int_distribution<uint32_t> percent(0, 99);
+    uint32_t value;
+
+    pthread_barrier_wait(data->startBarrier);
+    auto start = steady_clock::now();
+    for (uint64_t i = 0; i < data->operationCount; i++) {
+        uint64_t rank = data->distribution == DIST_ZIPF ? (*data->zipf)(engine) : uniformKey(engine);
+        const KeyValue& kv = data->keys[rank];
+        uint32_t op = percent(engine);
+
+        auto opStart = steady_clock::now();
+        if (op < insertPercentage) {
+            data->table->upsert(kv);
+        } else if (op < insertPercentage + deletePercentage) {
+            data->table->deleteKey(kv.key);
+        } else {
+            data->table->lookup(kv.key, value);
+        }
+        auto opEnd = steady_clock::now();
+        data->histogram.record(duration_cast<nanoseconds>(opEnd - opStart).count());
+    }
+    data->elapsedNs = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    return nullptr;
+}
+
+void runMixedRound(const KeyValue* keys, uint64_t keyCount, KeyDistribution distribution, const ZipfGenerator& zipf,
+                   int numThreads) {
+    UIntHashTable table(keyCount / LOAD_FACTOR_THRESHOLD + 1, TableOptions{bucketLockMode, isFilterEnabled});
+    table.insertMany(keys, keyCount);
+
+    uint64_t perThread = totalOperations / numThreads;
+    vector<pthread_t> threads(numThreads);
+    vector<MixArgs> args(numThreads);
+    pthread_barrier_t startBarrier;
+    pthread_barrier_init(&startBarrier, nullptr, numThreads);
+
+    for (int i = 0; i < numThreads; i++) {
+        args[i].table = &table;
+        args[i].keys = keys;
+        args[i].keyCount = keyCount;
+        args[i].operationCount = (i == numThreads - 1) ? totalOperations - i * perThread : perThread;
+        args[i].distribution = distribution;
+        args[i].zipf = &zipf;
+        args[i].seed = SEED + i;
+        args[i].startBarrier = &startBarrier;
+        args[i].elapsedNs = 0;
+        pthread_create(&threads[i], nullptr, mixedBatch, &args[i]);
+    }
+
+    LatencyHistogram histogram;
+    long wallNs = 0;
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], nullptr);
+        histogram.merge(args[i].histogram);
+        wallNs = max(wallNs, args[i].elapsedNs);
+    }
+    pthread_barrier_destroy(&startBarrier);
+
+    const char* name = distribution == DIST_ZIPF ? "zipf" : "uniform";
+    double seconds = wallNs / 1e9;
+    double opsPerSecond = seconds > 0 ? histogram.count() / seconds : 0.0;
+    if (isCsvEnabled) {
+        cout << numThreads << "," << name << "," << (distribution == DIST_ZIPF ? zipfTheta : 0.0) << ","
+             << insertPercentage << "," << deletePercentage << "," << histogram.count() << "," << seconds << ","
+             << (uint64_t)opsPerSecond << "," << histogram.percentile(0.50) << "," << histogram.percentile(0.99) << ","
+             << histogram.percentile(0.999) << "\n";
+    } else {
+        cout << name << " threads=" << numThreads << " ops/s=" << (uint64_t)opsPerSecond
+             << " p50(ns)=" << histogram.percentile(0.50) << " p99(ns)=" << histogram.percentile(0.99)
+             << " p999(ns)=" << histogram.percentile(0.999) << "\n";
+    }
+}
+
+void runMixedSweep(const KeyValue* keys, uint64_t keyCount, const int* threadCounts, int threadCountCount) {
+    ZipfGenerator zipf(keyCount, zipfTheta);
+    if (isCsvEnabled) {
+        cout << "threads,distribution,theta,insert_pct,delete_pct,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns\n";
+    }
+    for (KeyDistribution distribution : {DIST_UNIFORM, DIST_ZIPF}) {
+        for (int t = 0; t < threadCountCount; t++) {
+            runMixedRound(keys, keyCount, distribution, zipf, threadCounts[t]);
+        }
+    }
+}
+
+/**
+ * -cch=1: bounded CLOCK cache under a Zipf key stream (-zth) over the insert keys. Every thread does
+ * cache-aside: get, and put on a miss. Capacities are fractions of the key count; for each one the
+ * hit ratio, the evictions and the throughput over all threads are reported.
+ */
+using UIntCache = ConcurrentClockCache<uint32_t, uint32_t>;
+
+struct CacheArgs {
+    UIntCache* cache;
+    const KeyValue* keys;
+    const ZipfGenerator* zipf;
+    uint64_t operationCount;
+    uint64_t seed;
+    pthread_barrier_t* startBarrier;
+    long elapsedNs;
+};
+
+void* cacheBatch(void* args) {
+    CacheArgs* data = static_cast<CacheArgs*>(args);
+    mt19937_64 engine(data->seed);
+    uint32_t value;
+
+    pthread_barrier_wait(data->startBarrier);
+    auto start = steady_clock::now();
+    for (uint64_t i = 0; i < data->operationCount; i++) {
+        const KeyValue& kv = data->keys[(*data->zipf)(engine)];
+        if (!data->cache->get(kv.key, value)) {
+            data->cache->put(kv.key, kv.value);
+        }
+    }
+    data->elapsedNs = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    return nullptr;
+}
+
+void runCacheSweep(const KeyValue* keys, uint64_t keyCount, const int* threadCounts, int threadCountCount) {
+    ZipfGenerator zipf(keyCount, zipfTheta);
+    double capacityFractions[] = {0.01, 0.05, 0.1, 0.25, 0.5};
+    if (isCsvEnabled) {
+        cout << "threads,theta,capacity,ops,seconds,ops_per_sec,hit_ratio,evictions\n";
+    }
+
+    for (double fraction : capacityFractions) {
+        for (int t = 0; t < threadCountCount; t++) {
+            int numThreads = threadCounts[t];
+            UIntCache cache((uint32_t)(keyCount * fraction) + 1, TableOptions{bucketLockMode, isFilterEnabled});
+
+            uint64_t perThread = totalOperations / numThreads;
+            vector<pthread_t> threads(numThreads);
+            vector<CacheArgs> args(numThreads);
+            pthread_barrier_t startBarrier;
+            pthread_barrier_init(&startBarrier, nullptr, numThreads);
+            for (int i = 0; i < numThreads; i++) {
+                uint64_t n = (i == numThreads - 1) ? totalOperations - i * perThread : perThread;
+                args[i] = CacheArgs{&cache, keys, &zipf, n, SEED + i, &startBarrier, 0};
+                pthread_create(&threads[i], nullptr, cacheBatch, &args[i]);
+            }
+            long wallNs = 0;
+            for (int i = 0; i < numThreads; i++) {
+                pthread_join(threads[i], nullptr);
+                wallNs = max(wallNs, args[i].elapsedNs);
+            }
+            pthread_barrier_destroy(&startBarrier);
+
+            CacheStats stats = cache.stats();
+            double seconds = wallNs / 1e9;
+            double opsPerSecond = seconds > 0 ? totalOperations / seconds : 0.0;
+            double hitRatio = (double)stats.hits / max(stats.hits + stats.misses, (uint64_t)1);
+            if (isCsvEnabled) {
+                cout << numThreads << "," << zipfTheta << "," << cache.getCapacity() << "," << totalOperations << ","
+                     << seconds << "," << (uint64_t)opsPerSecond << "," << hitRatio << "," << stats.evictions << "\n";
+            } else {
+                cout << "capacity=" << cache.getCapacity() << " threads=" << numThreads
+                     << " ops/s=" << (uint64_t)opsPerSecond << " hit ratio=" << hitRatio
+                     << " evictions=" << stats.evictions << "\n";
+            }
+        }
+    }
+}
+
+/**
+ * -nma=1: sharded table with one shard per NUMA node, local vs interleaved placement.
+ * Thread t runs on node t % nodes and only uses keys routed to the shards of its node, so with
+ * local placement every access stays on the node; with interleaved placement the same threads and
+ * keys hit pages spread over all nodes. Both placements pin the threads the same way.
+ */
+struct NumaArgs {
+    UIntShardedTable* table;
+    const NumaTopology* topology;
+    int node;
+    const KeyValue* items;
+    uint64_t operationCount;
+    pthread_barrier_t* barrier;
+    long insertNs;
+    long searchNs;
+};
+
+void* numaBatch(void* args) {
+    NumaArgs* data = static_cast<NumaArgs*>(args);
+    data->topology->bindCurrentThread(data->node);
+    if (data->table->getPlacement() == PLACEMENT_INTERLEAVED) {
+        // the chain nodes this thread allocates are spread over the nodes as well
+        data->topology->setInterleave(true);
+    }
+    uint32_t value;
+
+    pthread_barrier_wait(data->barrier);
+    auto start = steady_clock::now();
+    for (uint64_t i = 0; i < data->operationCount; i++) {
+        data->table->insert(data->items[i]);
+    }
+    data->insertNs = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+
+    pthread_barrier_wait(data->barrier);
+    start = steady_clock::now();
+    for (uint64_t i = 0; i < data->operationCount; i++) {
+        data->table->lookup(data->items[i].key, value);
+    }
+    data->searchNs = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    return nullptr;
+}
+
+void runNumaComparison(const KeyValue* insertData, uint64_t count, const int* threadCounts, int threadCountCount) {
+    NumaTopology topology;
+    cout << "NUMA nodes: " << topology.nodeCount() << "\n";
+
+    for (ShardPlacement placement : {PLACEMENT_LOCAL, PLACEMENT_INTERLEAVED}) {
+        for (int t = 0; t < threadCountCount; t++) {
+            int numThreads = threadCounts[t];
+            UIntShardedTable table(topology, 1, count / LOAD_FACTOR_THRESHOLD + 1, placement);
+
+            // keys grouped by the node of their shard
+            vector<vector<KeyValue>> nodeKeys(topology.nodeCount());
+            for (uint64_t i = 0; i < count; i++) {
+                nodeKeys[table.nodeOfShard(table.shardOf(insertData[i].key))].push_back(insertData[i]);
+            }
+
+            vector<pthread_t> threads(numThreads);
+            vector<NumaArgs> args(numThreads);
+            pthread_barrier_t barrier;
+            pthread_barrier_init(&barrier, nullptr, numThreads);
+            for (int i = 0; i < numThreads; i++) {
+                int node = i % topology.nodeCount();
+                // threads of one node split its keys
+                int threadsOnNode = (numThreads - node + topology.nodeCount() - 1) / topology.nodeCount();
+                int rank = i / topology.nodeCount();
+                uint64_t perThread = nodeKeys[node].size() / threadsOnNode;
+                uint64_t n = rank == threadsOnNode - 1 ? nodeKeys[node].size() - rank * perThread : perThread;
+                args[i] = NumaArgs{&table, &topology, node, nodeKeys[node].data() + rank * perThread, n, &barrier, 0, 0};
+                pthread_create(&threads[i], nullptr, numaBatch, &args[i]);
+            }
+
+            long insertNs = 0;
+            long searchNs = 0;
+            for (int i = 0; i < numThreads; i++) {
+                pthread_join(threads[i], nullptr);
+                insertNs = max(insertNs, args[i].insertNs);
+                searchNs = max(searchNs, args[i].searchNs);
+            }
+            pthread_barrier_destroy(&barrier);
+
+            cout << (placement == PLACEMENT_LOCAL ? "local      " : "interleaved") << " threads=" << numThreads
+                 << " insert(ms)=" << insertNs / 1000000 << " [" << count * 1000.0 / max(insertNs, 1L)
+                 << " Mops/s] search(ms)=" << searchNs / 1000000 << " [" << count * 1000.0 / max(searchNs, 1L)
+                 << " Mops/s]\n";
+        }
+    }
+}
+
+// -img=1: saves a bulk-loaded table as an image, then per round reopens it (mmap warm start) and runs
+// the search and delete phases on it; the deletes copy the buckets they touch out of the image
+void runImageBenchmark(KeyValue* insertData, uint64_t adds, uint32_t* searchKeys, uint64_t searches,
+                       uint32_t* deleteKeys, uint64_t removes, const int* threadCounts, int threadCountCount) {
+    string imagePath = (filesystem::current_path() / "table_image.bin").string();
+
+    auto start = HR::now();
+    auto* source = new UIntHashTable(insertData, adds, threadCounts[threadCountCount - 1]);
+    long buildMs = duration_cast<milliseconds>(HR::now() - start).count();
+    start = HR::now();
+    bool saved = source->saveImage(imagePath);
+    long saveMs = duration_cast<milliseconds>(HR::now() - start).count();
+    delete source;
+    if (!saved) {
+        perror(("Unable to write the image " + imagePath).c_str());
+        exit(EXIT_FAILURE);
+    }
+    cout << "Bulk load time (ms): " << buildMs << " Save time (ms): " << saveMs << "\n";
+
+    for (int t = 0; t < threadCountCount; t++) {
+        int numThreads = threadCounts[t];
+        start = HR::now();
+        UIntHashTable* table = UIntHashTable::openImage(imagePath, TableOptions{bucketLockMode, isFilterEnabled});
+        long openMs = duration_cast<milliseconds>(HR::now() - start).count();
+        if (!table) {
+            cout << "Unable to open the image " << imagePath << "\n";
+            exit(EXIT_FAILURE);
+        }
+        long totalSearchTime = runPhase(searchBatch, table, searchKeys, searches, numThreads);
+        long totalDeleteTime = runPhase(deleteBatch, table, deleteKeys, removes, numThreads);
+
+        cout << "threads=" << numThreads << " open(ms)=" << openMs << " search(ms)=" << totalSearchTime / numThreads
+             << " delete(ms)=" << totalDeleteTime / numThreads << "\n";
+        delete table;
+    }
+    remove(imagePath.c_str());
+}
+
+struct LockTestArgs {
+    atomic<uintptr_t>* word;
+    uint64_t* counter;
+    atomic<int>* finished;
+};
+
+void* lockTestBatch(void* args) {
+    auto* lockArgs = (LockTestArgs*)args;
+    for (int i = 0; i < LOCK_TEST_ROUNDS; i++) {
+        EmbeddedBucketLock::lock(*lockArgs->word);
+        (*lockArgs->counter)++;
+        if (i % 64 == 0) {
+            // hold the lock across a reschedule, so the other threads run out of spins and park
+            sched_yield();
+        }
+        EmbeddedBucketLock::unlock(*lockArgs->word);
+    }
+    lockArgs->finished->fetch_add(1, memory_order_release);
+    return nullptr;
+}
+
+/**
+ * LOCK_TEST_THREADS threads take one embedded lock LOCK_TEST_ROUNDS times each. A lost wake-up
+ * leaves a thread parked for good, which shows up as a timeout; the counter checks exclusion.
+ */
+bool runLockTest() {
+    atomic<uintptr_t> word(0);
+    uint64_t counter = 0;
+    atomic<int> finished(0);
+    vector<pthread_t> threads(LOCK_TEST_THREADS);
+    LockTestArgs args{&word, &counter, &finished};
+    // give up the CPU between reading the sequence number and the lock word, where an unlock
+    // can slip in
+    EmbeddedBucketLock::parkingHook = []() { sched_yield(); };
+
+    auto start = HR::now();
+    for (int i = 0; i < LOCK_TEST_THREADS; i++) {
+        pthread_create(&threads[i], nullptr, lockTestBatch, &args);
+    }
+    while (finished.load(memory_order_acquire) < LOCK_TEST_THREADS) {
+        if (duration_cast<seconds>(HR::now() - start).count() >= LOCK_TEST_TIMEOUT_S) {
+            cout << "Lock test FAILED: " << LOCK_TEST_THREADS - finished.load() << " thread(s) still waiting after "
+                 << LOCK_TEST_TIMEOUT_S << " s\n";
+            return false;
+        }
+        usleep(10000);
+    }
+    for (int i = 0; i < LOCK_TEST_THREADS; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+    EmbeddedBucketLock::parkingHook = nullptr;
+
+    uint64_t expected = (uint64_t)LOCK_TEST_THREADS * LOCK_TEST_ROUNDS;
+    if (counter != expected || word.load() != 0) {
+        cout << "Lock test FAILED: counter " << counter << " of " << expected << ", word " << word.load() << "\n";
+        return false;
+    }
+    cout << "Lock test passed: " << expected << " acquisitions in "
+         << duration_cast<milliseconds>(HR::now() - start).count() << " ms\n";
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     for (int i = 1; i < argc; i++) {
         int error = parseArguments(argv[i]);
@@ -130,12 +751,21 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (isLockTestEnabled) {
+        // a hung thread can not be joined, leave without destructing anything
+        bool passed = runLockTest();
+        cout.flush();
+        _exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     uint64_t addOperations = totalOperations * (insertPercentage / 100.0);
     uint64_t removeOperations = totalOperations * (deletePercentage / 100.0);
     uint64_t searchOperations = totalOperations - (addOperations + removeOperations);
 
-    cout << "NUM OPS: " << totalOperations << " ADD: " << addOperations << " REM: " << removeOperations
-         << " FIND: " << searchOperations << "\n";
+    if (!isCsvEnabled) {
+        cout << "NUM OPS: " << totalOperations << " ADD: " << addOperations << " REM: " << removeOperations
+             << " FIND: " << searchOperations << "\n";
+    }
 
     assert(addOperations > 0);
 
@@ -157,33 +787,12 @@ int main(int argc, char* argv[]) {
     assert(filesystem::exists(deletePath));
     assert(filesystem::exists(searchPath));
 
-    auto* tempInsertKeys = new uint32_t[addOperations];
-    readDataFromFile(insertKeysPath, addOperations, tempInsertKeys);
-    auto* tempInsertValues = new uint32_t[addOperations];
-    readDataFromFile(insertValuesPath, addOperations, tempInsertValues);
-    for (int i = 0; i < addOperations; i++) {
-        insertData[i].key = tempInsertKeys[i];
-        insertData[i].value = tempInsertValues[i];
-    }
-    delete[] tempInsertKeys;
-    delete[] tempInsertValues;
-
+    readKeyValuesFromFiles(insertKeysPath, insertValuesPath, addOperations, insertData);
     if (removeOperations > 0) {
-        auto* tempDeleteKeys = new uint32_t[removeOperations];
-        readDataFromFile(deletePath, removeOperations, tempDeleteKeys);
-        for (int i = 0; i < removeOperations; i++) {
-            deleteKeys[i] = tempDeleteKeys[i];
-        }
-        delete[] tempDeleteKeys;
+        readDataFromFile(deletePath, removeOperations, deleteKeys);
     }
-
     if (searchOperations > 0) {
-        auto* tempSearchKeys = new uint32_t[searchOperations];
-        readDataFromFile(searchPath, searchOperations, tempSearchKeys);
-        for (int i = 0; i < searchOperations; i++) {
-            searchKeys[i] = tempSearchKeys[i];
-        }
-        delete[] tempSearchKeys;
+        readDataFromFile(searchPath, searchOperations, searchKeys);
     }
 
     mt19937 gen(SEED);
@@ -191,56 +800,104 @@ int main(int argc, char* argv[]) {
 
     int threadCounts[] = {1, 2, 4, 8, 16};
 
-    for (int numThreads : threadCounts) {
-        cout << "Running with " << numThreads << " threads...\n";
+    if (isCompareEnabled) {
+        for (int numThreads : threadCounts) {
+            auto* chained = new UIntHashTable(addOperations / LOAD_FACTOR_THRESHOLD + 1);
+            runComparison("chained", chained, insertData, addOperations, searchKeys, searchOperations, deleteKeys,
+                          removeOperations, numThreads);
+            printAllocatorStats();
+            delete chained;
+
+            auto* embedded = new UIntHashTable(addOperations / LOAD_FACTOR_THRESHOLD + 1, TableOptions{LOCK_EMBEDDED});
+            runComparison("chained(embedded lock)", embedded, insertData, addOperations, searchKeys, searchOperations,
+                          deleteKeys, removeOperations, numThreads);
+            delete embedded;
+
+            auto* filtered = new UIntHashTable(addOperations / LOAD_FACTOR_THRESHOLD + 1, TableOptions{LOCK_PTHREAD, true});
+            runComparison("chained(filter)", filtered, insertData, addOperations, searchKeys, searchOperations,
+                          deleteKeys, removeOperations, numThreads);
+            printFilterStats(filtered);
+            delete filtered;
+
+            auto* flat = new FlatConcurrentHashTable(addOperations);
+            runComparison("flat   ", flat, insertData, addOperations, searchKeys, searchOperations, deleteKeys,
+                          removeOperations, numThreads);
+            delete flat;
+
+            auto* swiss = new SwissConcurrentHashTable(addOperations);
+            runComparison("swiss  ", swiss, insertData, addOperations, searchKeys, searchOperations, deleteKeys,
+                          removeOperations, numThreads);
+            delete swiss;
+        }
 
-        uint64_t insertsPerThread = addOperations / numThreads;
-        uint64_t deletesPerThread = removeOperations / numThreads;
-        uint64_t searchesPerThread = searchOperations / numThreads;
+        delete[] insertData;
+        delete[] deleteKeys;
+        delete[] searchKeys;
+        return EXIT_SUCCESS;
+    }
 
-        long totalInsertTime = 0;
-        long totalDeleteTime = 0;
-        long totalSearchTime = 0;
+    if (isCacheEnabled) {
+        runCacheSweep(insertData, addOperations, threadCounts, sizeof(threadCounts) / sizeof(threadCounts[0]));
 
-        pthread_t insertThreads[numThreads];
-        for (int i = 0; i < numThreads; i++) {
-            ThreadArgs data = {insertData + i * insertsPerThread, insertsPerThread};
-            pthread_create(&insertThreads[i], nullptr, insertBatch, (void*)&data);
-        }
-        for (int i = 0; i < numThreads; i++) {
-            void* result;
-            pthread_join(insertThreads[i], &result);
-            totalInsertTime += *(long*)result;
-            delete (long*)result;
-        }
+        delete[] insertData;
+        delete[] deleteKeys;
+        delete[] searchKeys;
+        return EXIT_SUCCESS;
+    }
 
-        pthread_t deleteThreads[numThreads];
-        for (int i = 0; i < numThreads; i++) {
-            ThreadArgs data = {deleteKeys + i * deletesPerThread, deletesPerThread};
-            pthread_create(&deleteThreads[i], nullptr, deleteBatch, (void*)&data);
-        }
-        for (int i = 0; i < numThreads; i++) {
-            void* result;
-            pthread_join(deleteThreads[i], &result);
-            totalDeleteTime += *(long*)result;
-            delete (long*)result;
-        }
+    if (isImageEnabled) {
+        runImageBenchmark(insertData, addOperations, searchKeys, searchOperations, deleteKeys, removeOperations,
+                          threadCounts, sizeof(threadCounts) / sizeof(threadCounts[0]));
 
-        pthread_t searchThreads[numThreads];
-        for (int i = 0; i < numThreads; i++) {
-            ThreadArgs data = {searchKeys + i * searchesPerThread, searchesPerThread};
-            pthread_create(&searchThreads[i], nullptr, searchBatch, (void*)&data);
-        }
-        for (int i = 0; i < numThreads; i++) {
-            void* result;
-            pthread_join(searchThreads[i], &result);
-            totalSearchTime += *(long*)result;
-            delete (long*)result;
+        delete[] insertData;
+        delete[] deleteKeys;
+        delete[] searchKeys;
+        return EXIT_SUCCESS;
+    }
+
+    if (isNumaEnabled) {
+        runNumaComparison(insertData, addOperations, threadCounts, sizeof(threadCounts) / sizeof(threadCounts[0]));
+
+        delete[] insertData;
+        delete[] deleteKeys;
+        delete[] searchKeys;
+        return EXIT_SUCCESS;
+    }
+
+    if (isMixEnabled) {
+        runMixedSweep(insertData, addOperations, threadCounts, sizeof(threadCounts) / sizeof(threadCounts[0]));
+
+        delete[] insertData;
+        delete[] deleteKeys;
+        delete[] searchKeys;
+        return EXIT_SUCCESS;
+    }
+
+    for (int numThreads : threadCounts) {
+        cout << "Running with " << numThreads << " threads...\n";
+
+        // all phases of a round work on one shared table: searches see what the inserts left behind
+        unique_ptr<UIntHashTable> table;
+        if (isBulkLoadEnabled) {
+            auto start = HR::now();
+            table.reset(new UIntHashTable(insertData, addOperations, numThreads, TableOptions{bucketLockMode, isFilterEnabled}));
+            auto end = HR::now();
+            // wall time of the whole build, not a per-thread average
+            cout << "Bulk load time (ms): " << duration_cast<milliseconds>(end - start).count() << "\n";
+        } else {
+            table.reset(new UIntHashTable(INITIAL_BUCKET_COUNT, TableOptions{bucketLockMode, isFilterEnabled}));
+            long totalInsertTime = runPhase(insertBatch, table.get(), insertData, addOperations, numThreads);
+            cout << "Insert time (ms): " << totalInsertTime / numThreads << "\n";
         }
+        long totalDeleteTime = runPhase(deleteBatch, table.get(), deleteKeys, removeOperations, numThreads);
+        long totalSearchTime = runPhase(searchBatch, table.get(), searchKeys, searchOperations, numThreads);
 
-        cout << "Insert time (ms): " << totalInsertTime / numThreads << "\n";
         cout << "Delete time (ms): " << totalDeleteTime / numThreads << "\n";
         cout << "Search time (ms): " << totalSearchTime / numThreads << "\n";
+        printAllocatorStats();
+        if (isFilterEnabled) {
+            printFilterStats(table.get());
+        }
 
         sleep(1);
     }
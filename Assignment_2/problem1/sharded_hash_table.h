@@ -0,0 +1,263 @@
+#ifndef SHARDED_HASH_TABLE_H
+#define SHARDED_HASH_TABLE_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "concurrent_hash_table.h"
+
+using namespace std;
+
+// memory policy modes of set_mempolicy(2), called through syscall() so that libnuma is not needed
+#define NUMA_MPOL_DEFAULT 0
+#define NUMA_MPOL_INTERLEAVE 3
+
+/**
+ * NUMA nodes of the machine and their CPUs, read from /sys/devices/system/node.
+ * Without NUMA support (no sysfs entries, or a kernel without set_mempolicy) the machine is
+ * treated as a single node holding every online CPU.
+ */
+class NumaTopology {
+private:
+    vector<vector<int>> nodeCpus;
+
+    // parses a kernel cpu/node list such as "0-3,8,10-11"
+    static vector<int> parseList(const string& list) {
+        vector<int> values;
+        stringstream ranges(list);
+        string range;
+        while (getline(ranges, range, ',')) {
+            if (range.empty() || range == "\n") {
+                continue;
+            }
+            size_t dash = range.find('-');
+            int first = stoi(range.substr(0, dash));
+            int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+            for (int v = first; v <= last; v++) {
+                values.push_back(v);
+            }
+        }
+        return values;
+    }
+
+    static string readLine(const string& path) {
+        ifstream file(path);
+        string line;
+        getline(file, line);
+        return line;
+    }
+
+public:
+    NumaTopology() {
+        string online = readLine("/sys/devices/system/node/online");
+        if (!online.empty()) {
+            for (int node : parseList(online)) {
+                vector<int> cpus = parseList(readLine("/sys/devices/system/node/node" + to_string(node) + "/cpulist"));
+                if (!cpus.empty()) {
+                    nodeCpus.push_back(cpus);
+                }
+            }
+        }
+        if (nodeCpus.empty()) {
+            vector<int> cpus;
+            for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN); cpu++) {
+                cpus.push_back((int)cpu);
+            }
+            nodeCpus.push_back(cpus);
+        }
+    }
+
+    int nodeCount() const {
+        return (int)nodeCpus.size();
+    }
+
+    const vector<int>& cpusOf(int node) const {
+        return nodeCpus[node];
+    }
+
+    // pins the calling thread to the CPUs of 'node'; returns false if the affinity could not be set
+    bool bindCurrentThread(int node) const {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : nodeCpus[node]) {
+            CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    // lifts a binding made with bindCurrentThread
+    void unbindCurrentThread() const {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const vector<int>& cpus : nodeCpus) {
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    /**
+     * Switches the memory policy of the calling thread between interleaving new pages over all
+     * nodes and the default (first touch). Returns false if the kernel has no NUMA support.
+     */
+    bool setInterleave(bool interleave) const {
+        unsigned long mask = 0;
+        for (int node = 0; node < nodeCount() && node < (int)(8 * sizeof(mask)); node++) {
+            mask |= 1UL << node;
+        }
+        long status = interleave ? syscall(SYS_set_mempolicy, NUMA_MPOL_INTERLEAVE, &mask, 8 * sizeof(mask))
+                                 : syscall(SYS_set_mempolicy, NUMA_MPOL_DEFAULT, nullptr, 0);
+        return status == 0;
+    }
+};
+
+enum ShardPlacement { PLACEMENT_LOCAL, PLACEMENT_INTERLEAVED };
+
+/**
+ * Front-end that splits the key space over several ConcurrentHashTable shards, shardsPerNode of
+ * them per NUMA node. Shard s belongs to node s % nodeCount.
+ *
+ * With PLACEMENT_LOCAL every shard is built by a thread pinned to its node, so its bucket array
+ * and mutexes are first touched (and placed) there. Nodes come from the slab pool of the inserting
+ * thread and arrays of later resizes are allocated by the writer that starts them, so a shard stays
+ * local as long as the threads working on it run on its node (see bindToShard).
+ * With PLACEMENT_INTERLEAVED the shards are built with their pages spread round-robin over all
+ * nodes, which is the baseline the local placement is measured against.
+ *
+ * Keys are routed with the upper half of the hash, the shards index their buckets with the lower
+ * bits, so the two choices are independent.
+ */
+template <typename K, typename V, typename Hash = MixHash<K>, typename KeyEqual = equal_to<K>>
+class ShardedHashTable {
+public:
+    using Shard = ConcurrentHashTable<K, V, Hash, KeyEqual>;
+    using Pair = typename Shard::Pair;
+
+private:
+    const NumaTopology& topology;
+    ShardPlacement placement;
+    vector<Shard*> shards;
+    Hash hasher;
+
+    struct ShardBuild {
+        ShardedHashTable* self;
+        int shard;
+        uint32_t bucketsPerShard;
+    };
+
+    static void* buildShard(void* args) {
+        ShardBuild* build = static_cast<ShardBuild*>(args);
+        build->self->topology.bindCurrentThread(build->self->nodeOfShard(build->shard));
+        build->self->shards[build->shard] = new Shard(build->bucketsPerShard);
+        return nullptr;
+    }
+
+public:
+    ShardedHashTable(const NumaTopology& topology, int shardsPerNode = 1,
+                     uint32_t initialBucketCount = INITIAL_BUCKET_COUNT, ShardPlacement placement = PLACEMENT_LOCAL)
+        : topology(topology), placement(placement), shards(topology.nodeCount() * shardsPerNode, nullptr) {
+        uint32_t bucketsPerShard = initialBucketCount / shards.size() + 1;
+
+        if (placement == PLACEMENT_INTERLEAVED) {
+            bool interleaved = topology.setInterleave(true);
+            for (size_t s = 0; s < shards.size(); s++) {
+                shards[s] = new Shard(bucketsPerShard);
+            }
+            if (interleaved) {
+                topology.setInterleave(false);
+            }
+            return;
+        }
+
+        vector<pthread_t> builders(shards.size());
+        vector<ShardBuild> builds(shards.size());
+        for (size_t s = 0; s < shards.size(); s++) {
+            builds[s] = ShardBuild{this, (int)s, bucketsPerShard};
+            pthread_create(&builders[s], nullptr, buildShard, &builds[s]);
+        }
+        for (size_t s = 0; s < shards.size(); s++) {
+            pthread_join(builders[s], nullptr);
+        }
+    }
+
+    ~ShardedHashTable() {
+        for (Shard* shard : shards) {
+            delete shard;
+        }
+    }
+
+    ShardedHashTable(const ShardedHashTable&) = delete;
+    ShardedHashTable& operator=(const ShardedHashTable&) = delete;
+
+    int shardCount() const {
+        return (int)shards.size();
+    }
+
+    int nodeOfShard(int shard) const {
+        return shard % topology.nodeCount();
+    }
+
+    int shardOf(const K& key) const {
+        return (int)(((uint64_t)hasher(key) >> 32) % shards.size());
+    }
+
+    ShardPlacement getPlacement() const {
+        return placement;
+    }
+
+    /**
+     * Affinity hint: pins the calling thread to the node of 'shard'. Threads that mostly work on
+     * the keys of one shard (shardOf) should call it once before they start.
+     */
+    bool bindToShard(int shard) const {
+        return topology.bindCurrentThread(nodeOfShard(shard));
+    }
+
+    void insert(Pair kv) {
+        shards[shardOf(kv.key)]->insert(std::move(kv));
+    }
+
+    void insert(K key, V value) {
+        insert(Pair{std::move(key), std::move(value)});
+    }
+
+    bool deleteKey(const K& key) {
+        return shards[shardOf(key)]->deleteKey(key);
+    }
+
+    bool upsert(Pair kv) {
+        return shards[shardOf(kv.key)]->upsert(std::move(kv));
+    }
+
+    bool insertIfAbsent(Pair kv) {
+        return shards[shardOf(kv.key)]->insertIfAbsent(std::move(kv));
+    }
+
+    template <typename Fn>
+    bool compute(const K& key, Fn fn) {
+        return shards[shardOf(key)]->compute(key, fn);
+    }
+
+    V fetchAdd(const K& key, V delta) {
+        return shards[shardOf(key)]->fetchAdd(key, delta);
+    }
+
+    bool lookup(const K& key, V& value) {
+        return shards[shardOf(key)]->lookup(key, value);
+    }
+
+    Shard& shard(int s) {
+        return *shards[s];
+    }
+};
+
+#endif
@@ -0,0 +1,454 @@
+#ifndef SWISS_HASH_TABLE_H
+#define SWISS_HASH_TABLE_H
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "concurrent_hash_table.h"
+#include "cpu_hints.h"
+
+using namespace std;
+
+#define SWISS_GROUP_SIZE 16
+// live entries per slot the table is sized for
+#define SWISS_MAX_LOAD_FACTOR 0.875
+// live plus deleted entries per slot at which the table is rehashed
+#define SWISS_MAX_FILL 0.9375
+// writer locks, selected by the top bits of the key hash (power of two)
+#define SWISS_WRITER_STRIPES 64
+
+/**
+ * Bucketized variant of ConcurrentHashTable in the style of SwissTable / F14.
+ *
+ * Slots are organized in groups of 16. Every group has 16 one-byte control tags (7 bits of the
+ * hash for a full slot, or EMPTY / DELETED) and a lookup compares all of them against the tag of
+ * its key with one SSE2 compare; only the slots that match are read. Groups are probed linearly.
+ *
+ * Writers change a group only while holding its version counter odd. Readers take no lock:
+ * they read the version, the tags and the matching slots, and start over on the group if the
+ * version changed meanwhile (seqlock). Tags and slots are relaxed atomics, so an optimistic read
+ * is never a data race, only possibly stale.
+ *
+ * insert and deleteKey first lock the writer stripe of their key, so the tag and slot of a key
+ * only change under that stripe and its writers can scan for it without locking groups. An insert
+ * takes the first DELETED or EMPTY slot on the probe path once it has seen that the key is not
+ * further along. EMPTY slots only disappear, so a key is never found behind a group that still
+ * has one, which ends both lookups and the duplicate check of inserts.
+ *
+ * Every stripe counts the EMPTY slots its inserts used up; one that reaches its share of
+ * SWISS_MAX_FILL takes all stripe locks and rehashes the live entries into a new group array
+ * (larger if needed), and the old array is freed through the epoch domain. Like the flat table,
+ * insert keeps keys unique and overwrites the value of a present key.
+ */
+class SwissConcurrentHashTable {
+private:
+    static constexpr uint8_t EMPTY_TAG = 0x80;
+    static constexpr uint8_t DELETED_TAG = 0xFE;
+    static constexpr uint64_t EMPTY_TAGS = 0x8080808080808080ULL;
+    static constexpr int STRIPE_SHIFT = 64 - __builtin_ctz(SWISS_WRITER_STRIPES);
+    // enough groups that every stripe gets a budget
+    static constexpr uint64_t MIN_GROUPS = SWISS_WRITER_STRIPES / 2;
+
+    struct alignas(CACHE_LINE_SIZE) Group {
+        atomic<uint32_t> version;
+        atomic<uint64_t> ctrl[2];                    // tags of slots 0-7 and 8-15
+        atomic<uint64_t> slots[SWISS_GROUP_SIZE];    // {key, value} packed like in the flat table
+    };
+
+    struct GroupArray {
+        Group* groups;
+        uint64_t groupCount;
+        uint64_t groupMask;
+        uint64_t stripeBudget;    // EMPTY slots one stripe may use up before a rehash
+
+        explicit GroupArray(uint64_t groupCount) : groupCount(groupCount), groupMask(groupCount - 1) {
+            stripeBudget = (uint64_t)(groupCount * SWISS_GROUP_SIZE * SWISS_MAX_FILL) / SWISS_WRITER_STRIPES;
+            void* memory = aligned_alloc(alignof(Group), groupCount * sizeof(Group));
+            if (!memory) {
+                throw bad_alloc();
+            }
+            groups = static_cast<Group*>(memory);
+            for (uint64_t g = 0; g < groupCount; g++) {
+                Group* group = new (&groups[g]) Group;
+                group->version.store(0, memory_order_relaxed);
+                group->ctrl[0].store(EMPTY_TAGS, memory_order_relaxed);
+                group->ctrl[1].store(EMPTY_TAGS, memory_order_relaxed);
+                for (int i = 0; i < SWISS_GROUP_SIZE; i++) {
+                    group->slots[i].store(0, memory_order_relaxed);
+                }
+            }
+        }
+
+        ~GroupArray() {
+            free(groups);
+        }
+
+        uint64_t groupOf(size_t hash) const {
+            return (hash >> 7) & groupMask;
+        }
+    };
+
+    struct alignas(CACHE_LINE_SIZE) WriterStripe {
+        pthread_mutex_t lock;
+        uint64_t claimed;    // EMPTY slots filled by this stripe since the last rehash
+    };
+
+    atomic<GroupArray*> current;
+    WriterStripe stripes[SWISS_WRITER_STRIPES];
+    MixHash<uint32_t> hasher;
+
+    static uint64_t pack(uint32_t key, uint32_t value) {
+        return ((uint64_t)key << 32) | value;
+    }
+
+    static uint32_t keyOf(uint64_t word) {
+        return (uint32_t)(word >> 32);
+    }
+
+    // bit i is set if tag i equals 'tag'
+    static uint32_t matchTags(uint64_t low, uint64_t high, uint8_t tag) {
+#if defined(__SSE2__)
+        __m128i ctrl = _mm_set_epi64x((long long)high, (long long)low);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < SWISS_GROUP_SIZE; i++) {
+            uint64_t word = i < 8 ? low : high;
+            if ((uint8_t)(word >> (8 * (i % 8))) == tag) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+#endif
+    }
+
+    static uint8_t tagOf(size_t hash) {
+        return (uint8_t)(hash & 0x7F);
+    }
+
+    static uint32_t stripeOf(size_t hash) {
+        return (uint32_t)((uint64_t)hash >> STRIPE_SHIFT);
+    }
+
+    static uint64_t groupCountFor(uint64_t entries) {
+        uint64_t needed = (uint64_t)(entries / SWISS_MAX_LOAD_FACTOR) / SWISS_GROUP_SIZE + 1;
+        uint64_t groupCount = MIN_GROUPS;
+        while (groupCount < needed) {
+            groupCount <<= 1;
+        }
+        return groupCount;
+    }
+
+    static void deleteArray(void* array) {
+        delete static_cast<GroupArray*>(array);
+    }
+
+    static void lockGroup(Group& group) {
+        uint32_t version = group.version.load(memory_order_relaxed);
+        while (true) {
+            if (!(version & 1) &&
+                group.version.compare_exchange_weak(version, version + 1, memory_order_acquire, memory_order_relaxed)) {
+                // a reader that sees any of the following stores also sees the odd version
+                atomic_thread_fence(memory_order_release);
+                return;
+            }
+            cpuRelax();
+            version = group.version.load(memory_order_relaxed);
+        }
+    }
+
+    static void unlockGroup(Group& group) {
+        group.version.store(group.version.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    /**
+     * Only called with the group locked. Release: a writer that scans the tags without the group
+     * lock (acquire) and sees the new tag also sees the slot stored before it.
+     */
+    static void setTag(Group& group, int slot, uint8_t tag) {
+        atomic<uint64_t>& word = group.ctrl[slot / 8];
+        int shift = 8 * (slot % 8);
+        uint64_t tags = word.load(memory_order_relaxed);
+        tags = (tags & ~(0xFFULL << shift)) | ((uint64_t)tag << shift);
+        word.store(tags, memory_order_release);
+    }
+
+    /**
+     * Index of 'key' in the group (tags loaded with acquire), or -1. Exact without the group lock
+     * for a caller that holds the stripe of the key: no other writer stores this key or changes
+     * the tag of a slot holding it.
+     */
+    static int findKey(Group& group, uint64_t low, uint64_t high, uint32_t key, uint8_t tag) {
+        uint32_t matches = matchTags(low, high, tag);
+        while (matches) {
+            int i = __builtin_ctz(matches);
+            if (keyOf(group.slots[i].load(memory_order_relaxed)) == key) {
+                return i;
+            }
+            matches &= matches - 1;
+        }
+        return -1;
+    }
+
+    /**
+     * Insert body, the caller holds the stripe lock of the key. Returns false only if no group on
+     * the whole probe path has a free slot.
+     */
+    bool insertLocked(GroupArray* array, uint32_t key, uint64_t desired, size_t hash, WriterStripe& stripe) {
+        uint8_t tag = tagOf(hash);
+        while (true) {
+            uint64_t g = array->groupOf(hash);
+            uint64_t target = array->groupCount;
+            for (uint64_t probes = 0; probes < array->groupCount; probes++) {
+                Group& group = array->groups[g];
+                uint64_t low = group.ctrl[0].load(memory_order_acquire);
+                uint64_t high = group.ctrl[1].load(memory_order_acquire);
+                int slot = findKey(group, low, high, key, tag);
+                if (slot >= 0) {
+                    lockGroup(group);
+                    group.slots[slot].store(desired, memory_order_relaxed);
+                    unlockGroup(group);
+                    return true;
+                }
+                bool hasEmpty = matchTags(low, high, EMPTY_TAG) != 0;
+                if (target == array->groupCount && (hasEmpty || matchTags(low, high, DELETED_TAG))) {
+                    target = g;
+                }
+                if (hasEmpty) {
+                    break;
+                }
+                g = (g + 1) & array->groupMask;
+            }
+            if (target == array->groupCount) {
+                return false;
+            }
+
+            // the key is absent: take a free slot of the first group that had one, DELETED first
+            Group& group = array->groups[target];
+            lockGroup(group);
+            uint64_t low = group.ctrl[0].load(memory_order_relaxed);
+            uint64_t high = group.ctrl[1].load(memory_order_relaxed);
+            uint32_t deleted = matchTags(low, high, DELETED_TAG);
+            uint32_t empties = matchTags(low, high, EMPTY_TAG);
+            if (deleted || empties) {
+                int slot = __builtin_ctz(deleted ? deleted : empties);
+                group.slots[slot].store(desired, memory_order_relaxed);
+                setTag(group, slot, tag);
+                unlockGroup(group);
+                if (!deleted) {
+                    stripe.claimed++;
+                }
+                return true;
+            }
+            // inserts of other stripes filled the group meanwhile, probe again
+            unlockGroup(group);
+        }
+    }
+
+    /**
+     * Replaces 'seen' by a new array holding only the live entries, unless another thread already
+     * did. Takes every stripe lock; the caller holds none.
+     */
+    void rehash(GroupArray* seen) {
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_lock(&stripe.lock);
+        }
+        GroupArray* old = current.load(memory_order_relaxed);
+        if (old == seen) {
+            uint64_t live = 0;
+            uint64_t stripeLive[SWISS_WRITER_STRIPES] = {0};
+            for (uint64_t g = 0; g < old->groupCount; g++) {
+                for (int i = 0; i < SWISS_GROUP_SIZE; i++) {
+                    uint8_t tag = (uint8_t)(old->groups[g].ctrl[i / 8].load(memory_order_relaxed) >> (8 * (i % 8)));
+                    if (tag != EMPTY_TAG && tag != DELETED_TAG) {
+                        live++;
+                        stripeLive[stripeOf(hasher(keyOf(old->groups[g].slots[i].load(memory_order_relaxed))))]++;
+                    }
+                }
+            }
+            uint64_t busiestStripe = *max_element(stripeLive, stripeLive + SWISS_WRITER_STRIPES);
+
+            // leave every stripe at least half of its budget
+            uint64_t groupCount = max(old->groupCount, groupCountFor(live));
+            while (busiestStripe * 2 >
+                   (uint64_t)(groupCount * SWISS_GROUP_SIZE * SWISS_MAX_FILL) / SWISS_WRITER_STRIPES) {
+                groupCount <<= 1;
+            }
+
+            GroupArray* fresh = new GroupArray(groupCount);
+            for (uint64_t g = 0; g < old->groupCount; g++) {
+                for (int i = 0; i < SWISS_GROUP_SIZE; i++) {
+                    uint8_t tag = (uint8_t)(old->groups[g].ctrl[i / 8].load(memory_order_relaxed) >> (8 * (i % 8)));
+                    if (tag == EMPTY_TAG || tag == DELETED_TAG) {
+                        continue;
+                    }
+                    uint64_t word = old->groups[g].slots[i].load(memory_order_relaxed);
+                    uint64_t target = fresh->groupOf(hasher(keyOf(word)));
+                    uint32_t empties;
+                    while (!(empties = matchTags(fresh->groups[target].ctrl[0].load(memory_order_relaxed),
+                                                 fresh->groups[target].ctrl[1].load(memory_order_relaxed),
+                                                 EMPTY_TAG))) {
+                        target = (target + 1) & fresh->groupMask;
+                    }
+                    int slot = __builtin_ctz(empties);
+                    fresh->groups[target].slots[slot].store(word, memory_order_relaxed);
+                    setTag(fresh->groups[target], slot, tag);
+                }
+            }
+            for (int s = 0; s < SWISS_WRITER_STRIPES; s++) {
+                stripes[s].claimed = stripeLive[s];
+            }
+            current.store(fresh, memory_order_release);
+            EpochDomain::instance().retire(old, deleteArray);
+        }
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_unlock(&stripe.lock);
+        }
+    }
+
+public:
+    SwissConcurrentHashTable(uint64_t expectedEntries = INITIAL_BUCKET_COUNT) {
+        current.store(new GroupArray(groupCountFor(expectedEntries)), memory_order_relaxed);
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_init(&stripe.lock, nullptr);
+            stripe.claimed = 0;
+        }
+    }
+
+    ~SwissConcurrentHashTable() {
+        for (WriterStripe& stripe : stripes) {
+            pthread_mutex_destroy(&stripe.lock);
+        }
+        delete current.load(memory_order_relaxed);
+    }
+
+    SwissConcurrentHashTable(const SwissConcurrentHashTable&) = delete;
+    SwissConcurrentHashTable& operator=(const SwissConcurrentHashTable&) = delete;
+
+    // inserts kv, or overwrites the value if the key is already present
+    bool insert(KeyValue kv) {
+        size_t hash = hasher(kv.key);
+        uint64_t desired = pack(kv.key, kv.value);
+        WriterStripe& stripe = stripes[stripeOf(hash)];
+
+        while (true) {
+            pthread_mutex_lock(&stripe.lock);
+            GroupArray* array = current.load(memory_order_acquire);
+            if (stripe.claimed < array->stripeBudget && insertLocked(array, kv.key, desired, hash, stripe)) {
+                pthread_mutex_unlock(&stripe.lock);
+                return true;
+            }
+            pthread_mutex_unlock(&stripe.lock);
+            rehash(array);
+        }
+    }
+
+    bool deleteKey(uint32_t key) {
+        size_t hash = hasher(key);
+        uint8_t tag = tagOf(hash);
+        WriterStripe& stripe = stripes[stripeOf(hash)];
+        pthread_mutex_lock(&stripe.lock);
+        GroupArray* array = current.load(memory_order_acquire);
+        uint64_t g = array->groupOf(hash);
+        bool deleted = false;
+
+        for (uint64_t probes = 0; probes < array->groupCount; probes++) {
+            Group& group = array->groups[g];
+            uint64_t low = group.ctrl[0].load(memory_order_acquire);
+            uint64_t high = group.ctrl[1].load(memory_order_acquire);
+            int slot = findKey(group, low, high, key, tag);
+            if (slot >= 0) {
+                lockGroup(group);
+                setTag(group, slot, DELETED_TAG);
+                unlockGroup(group);
+                deleted = true;
+                break;
+            }
+            if (matchTags(low, high, EMPTY_TAG)) {
+                break;
+            }
+            g = (g + 1) & array->groupMask;
+        }
+        pthread_mutex_unlock(&stripe.lock);
+        return deleted;
+    }
+
+    bool lookup(uint32_t key, uint32_t &value) {
+        size_t hash = hasher(key);
+        uint8_t tag = tagOf(hash);
+        EpochGuard guard;
+        GroupArray* array = current.load(memory_order_acquire);
+        uint64_t g = array->groupOf(hash);
+
+        for (uint64_t probes = 0; probes < array->groupCount; probes++) {
+            Group& group = array->groups[g];
+            while (true) {
+                uint32_t version = group.version.load(memory_order_acquire);
+                if (version & 1) {
+                    cpuRelax();
+                    continue;
+                }
+                uint64_t low = group.ctrl[0].load(memory_order_relaxed);
+                uint64_t high = group.ctrl[1].load(memory_order_relaxed);
+                uint32_t matches = matchTags(low, high, tag);
+                bool found = false;
+                uint64_t word = 0;
+                while (matches) {
+                    word = group.slots[__builtin_ctz(matches)].load(memory_order_relaxed);
+                    if (keyOf(word) == key) {
+                        found = true;
+                        break;
+                    }
+                    matches &= matches - 1;
+                }
+                bool hasEmpty = matchTags(low, high, EMPTY_TAG) != 0;
+
+                // the reads above must not move after the version check
+                atomic_thread_fence(memory_order_acquire);
+                if (group.version.load(memory_order_relaxed) != version) {
+                    continue;
+                }
+                if (found) {
+                    value = (uint32_t)word;
+                    return true;
+                }
+                if (hasEmpty) {
+                    return false;
+                }
+                break;
+            }
+            g = (g + 1) & array->groupMask;
+        }
+        return false;
+    }
+
+    uint64_t getCapacity() const {
+        return current.load(memory_order_acquire)->groupCount * SWISS_GROUP_SIZE;
+    }
+
+    // not safe against a concurrent rehash
+    void printTableContents() {
+        GroupArray* array = current.load(memory_order_acquire);
+        for (uint64_t g = 0; g < array->groupCount; g++) {
+            for (int i = 0; i < SWISS_GROUP_SIZE; i++) {
+                uint8_t tag = (uint8_t)(array->groups[g].ctrl[i / 8].load(memory_order_acquire) >> (8 * (i % 8)));
+                if (tag != EMPTY_TAG && tag != DELETED_TAG) {
+                    uint64_t word = array->groups[g].slots[i].load(memory_order_acquire);
+                    cout << "Key: " << keyOf(word) << " Value: " << (uint32_t)word << endl;
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef TABLE_IMAGE_H
+#define TABLE_IMAGE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// "CHTIMG01" in little endian, first word of every image file
+#define TABLE_IMAGE_MAGIC 0x3130474D49544843ULL
+
+/**
+ * On-disk image of a ConcurrentHashTable:
+ *
+ *   TableImageHeader | uint64_t offsets[bucketCount + 1] | Pair pairs[pairCount]
+ *
+ * The pairs of bucket b are pairs[offsets[b] .. offsets[b + 1]), in chain order. The bucket count
+ * is the one of the saved table, so a key is found in bucket hash & (bucketCount - 1) as long as
+ * the image is reopened with the same Hash. Pairs are stored as raw bytes (trivially copyable
+ * pairs only) in the byte order of the machine that wrote them.
+ */
+struct TableImageHeader {
+    uint64_t magic;
+    uint32_t pairSize;
+    uint32_t reserved;
+    uint64_t bucketCount;
+    uint64_t pairCount;
+};
+
+// streams the buckets of a table into an image file, one bucket at a time and in bucket order
+template <typename Pair>
+class TableImageWriter {
+private:
+    FILE* file = nullptr;
+    vector<uint64_t> offsets;
+    uint64_t written = 0;
+    bool failed = false;
+
+public:
+    TableImageWriter() = default;
+    TableImageWriter(const TableImageWriter&) = delete;
+    TableImageWriter& operator=(const TableImageWriter&) = delete;
+
+    ~TableImageWriter() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool open(const string& path, uint64_t bucketCount) {
+        static_assert(is_trivially_copyable<Pair>::value, "only trivially copyable pairs can be saved");
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        offsets.assign(bucketCount + 1, 0);
+        // header and offsets are written last, the pairs start right behind them
+        return fseek(file, sizeof(TableImageHeader) + offsets.size() * sizeof(uint64_t), SEEK_SET) == 0;
+    }
+
+    void writeBucket(uint64_t bucket, const Pair* pairs, size_t count) {
+        offsets[bucket] = written;
+        if (count > 0 && fwrite(pairs, sizeof(Pair), count, file) != count) {
+            failed = true;
+        }
+        written += count;
+    }
+
+    bool finish() {
+        offsets.back() = written;
+        TableImageHeader header = {TABLE_IMAGE_MAGIC, (uint32_t)sizeof(Pair), 0, offsets.size() - 1, written};
+        failed |= fseek(file, 0, SEEK_SET) != 0;
+        failed |= fwrite(&header, sizeof(header), 1, file) != 1;
+        failed |= fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) != offsets.size();
+        failed |= fclose(file) != 0;
+        file = nullptr;
+        return !failed;
+    }
+};
+
+/**
+ * Read-only mapping of an image file. The pages are only read in when a bucket is first used,
+ * so opening costs one mmap and a pass over the offsets, whatever the size of the image.
+ */
+template <typename Pair>
+class MappedTableImage {
+private:
+    void* mapping = MAP_FAILED;
+    size_t bytes = 0;
+    const TableImageHeader* header = nullptr;
+    const uint64_t* offsets = nullptr;
+    const Pair* pairs = nullptr;
+
+public:
+    MappedTableImage() = default;
+    MappedTableImage(const MappedTableImage&) = delete;
+    MappedTableImage& operator=(const MappedTableImage&) = delete;
+
+    ~MappedTableImage() {
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, bytes);
+        }
+    }
+
+    // maps and validates the image; false if the file is missing, truncated or not an image of Pair
+    bool open(const string& path) {
+        static_assert(is_trivially_copyable<Pair>::value, "only trivially copyable pairs can be mapped");
+        static_assert(alignof(Pair) <= alignof(uint64_t), "pairs are only 8-byte aligned in the image");
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TableImageHeader)) {
+            close(fd);
+            return false;
+        }
+        bytes = info.st_size;
+        mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+
+        header = static_cast<const TableImageHeader*>(mapping);
+        uint64_t buckets = header->bucketCount;
+        if (header->magic != TABLE_IMAGE_MAGIC || header->pairSize != sizeof(Pair) || buckets == 0 ||
+            buckets > (1ULL << 31) || (buckets & (buckets - 1)) != 0 ||
+            bytes != sizeof(TableImageHeader) + (buckets + 1) * sizeof(uint64_t) + header->pairCount * sizeof(Pair)) {
+            return false;
+        }
+        offsets = reinterpret_cast<const uint64_t*>(header + 1);
+        pairs = reinterpret_cast<const Pair*>(offsets + buckets + 1);
+        for (uint64_t b = 0; b < buckets; b++) {
+            if (offsets[b] > offsets[b + 1]) {
+                return false;
+            }
+        }
+        return offsets[0] == 0 && offsets[buckets] == header->pairCount;
+    }
+
+    uint64_t bucketCount() const {
+        return header->bucketCount;
+    }
+
+    uint64_t pairCount() const {
+        return header->pairCount;
+    }
+
+    const Pair* bucketBegin(uint64_t bucket) const {
+        return pairs + offsets[bucket];
+    }
+
+    const Pair* bucketEnd(uint64_t bucket) const {
+        return pairs + offsets[bucket + 1];
+    }
+};
+
+#endif
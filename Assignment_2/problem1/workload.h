@@ -0,0 +1,123 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Zipfian ranks in [0, n) after Gray et al., "Quickly Generating Billion-Record Synthetic
+ * Databases" (the generator used by YCSB): rank 0 is the most popular, the probability of rank i
+ * is proportional to 1 / (i + 1)^theta. zeta(n) is summed once in the constructor, every sample
+ * is O(1). The generator is immutable after construction, so threads can share one and draw from
+ * it with their own random engine.
+ */
+class ZipfGenerator {
+private:
+    uint64_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double halfPowTheta;
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) {
+            sum += 1.0 / pow((double)i, theta);
+        }
+        return sum;
+    }
+
+public:
+    ZipfGenerator(uint64_t n, double theta) : n(n), theta(theta) {
+        alpha = 1.0 / (1.0 - theta);
+        zetan = zeta(n, theta);
+        double zeta2 = zeta(2, theta);
+        eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+        halfPowTheta = 1.0 + pow(0.5, theta);
+    }
+
+    template <typename Engine>
+    uint64_t operator()(Engine& engine) const {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(engine);
+        double uz = u * zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < halfPowTheta) {
+            return 1;
+        }
+        return min(n - 1, (uint64_t)(n * pow(eta * u - eta + 1.0, alpha)));
+    }
+};
+
+/**
+ * Log-linear latency histogram (nanoseconds): values below 16 are exact, above that every power
+ * of two is split into 16 buckets, so a percentile is off by less than 1/16 of its value.
+ * Each thread fills its own histogram; they are merged after the run.
+ */
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    vector<uint64_t> counts;
+    uint64_t total = 0;
+
+    static int bucketOf(uint64_t ns) {
+        if (ns < SUB_BUCKETS) {
+            return (int)ns;
+        }
+        int msb = 63 - __builtin_clzll(ns);
+        return (msb - SUB_BITS + 1) * SUB_BUCKETS + (int)((ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+    }
+
+    // smallest value that falls into bucket b
+    static uint64_t lowerBound(int b) {
+        if (b < SUB_BUCKETS) {
+            return b;
+        }
+        int msb = b / SUB_BUCKETS + SUB_BITS - 1;
+        return (uint64_t)(SUB_BUCKETS + b % SUB_BUCKETS) << (msb - SUB_BITS);
+    }
+
+public:
+    LatencyHistogram() : counts(BUCKET_COUNT, 0) {}
+
+    void record(uint64_t ns) {
+        counts[bucketOf(ns)]++;
+        total++;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int b = 0; b < BUCKET_COUNT; b++) {
+            counts[b] += other.counts[b];
+        }
+        total += other.total;
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    // value below which a fraction p (0..1) of the recorded latencies lie
+    uint64_t percentile(double p) const {
+        uint64_t target = (uint64_t)ceil(p * total);
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKET_COUNT; b++) {
+            seen += counts[b];
+            if (seen >= target && seen > 0) {
+                return lowerBound(b);
+            }
+        }
+        return 0;
+    }
+};
+
+#endif
@@ -1,11 +1,32 @@
 #ifndef CONCURRENT_QUEUE_H
 #define CONCURRENT_QUEUE_H
 
+#include <algorithm>
 #include <atomic>
+#include <climits>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <cassert>
+#include <chrono>
+#include <new>
+#include <optional>
 #include <thread> // for std::this_thread::sleep_for
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "event_count.h"
+#include "node_freelist.h"
+#include "reclamation.h"
+
+// largest trivially copyable item LockFreeQueue copies out before detaching it
+#define QUEUE_EARLY_COPY_MAX 16
+// failed dequeue attempts deq_wait / deq_for spin before parking the thread
+#define QUEUE_SPINS_BEFORE_PARK 128
 
 /**
  * 128-bit pointer+version that we can CAS atomically in one shot.
@@ -17,29 +38,59 @@ struct PtrVersion {
 };
 
 /**
- * Lock-free queue node. 'next' is itself a 128-bit atomic
- * so we can do versioned CAS and avoid ABA.
+ * Michael-Scott lock-free queue of T. Nodes come from a NodeFreelist and an unlinked node is
+ * handed to the Reclaim policy (reclamation.h), which recycles it once no other thread can still
+ * dereference it: a dequeuer that loaded the old head may be about to read its 'next'.
+ *
+ * Items live in the node itself, so an enqueue costs one node from the freelist and nothing else.
+ * Small trivially copyable items (at most QUEUE_EARLY_COPY_MAX bytes) are copied out before the
+ * CAS that detaches them, as in the original algorithm; a failed CAS just drops the copy. Any
+ * other T (move-only, owning, large) is moved out after the CAS, which is safe because the
+ * dequeuer still protects the node, and destroyed in place. That requires a real reclamation
+ * policy: with ImmediateReclamation the node may be reused while the item is moved.
+ *
+ * deq_wait / deq_for block on an empty queue: they spin for a while and then park on an
+ * EventCount. Producers check for parked consumers after every enqueue but only make a syscall
+ * when there are some.
  */
+template <typename T = int, typename Reclaim = HazardPointerReclamation>
 class LockFreeQueue {
 private:
+    static constexpr bool EARLY_COPY = std::is_trivially_copyable<T>::value && sizeof(T) <= QUEUE_EARLY_COPY_MAX;
+    static_assert(EARLY_COPY || !std::is_same<Reclaim, ImmediateReclamation>::value,
+                  "items that are moved out after the CAS need hazard pointers or epochs");
+
+    /**
+     * Lock-free queue node. 'next' is itself a 128-bit atomic
+     * so we can do versioned CAS and avoid ABA. The item is constructed in 'storage' by the
+     * enqueuer; the dummy node at the head holds none.
+     *
+     * The constructor leaves 'next' alone, so its version carries over when the freelist recycles
+     * the node (see makeNode).
+     */
     struct Node {
-        int value;
+        alignas(T) unsigned char storage[sizeof(T)];
         std::atomic<PtrVersion> next;
+
+        Node() {}
+
+        T* item() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
     };
 
+    using Freelist = NodeFreelist<Node>;
+
     // Head and tail also store pointer+version so we can do 128-bit CAS on them.
     std::atomic<PtrVersion> head;
     std::atomic<PtrVersion> tail;
+    EventCount nonEmpty;
 
 public:
     LockFreeQueue() {
         // Make a dummy node
-        Node* dummy = new Node();
-        dummy->value = 0;
-
-        // Set dummy->next to {nullptr, 0}
-        PtrVersion dummyNext = {nullptr, 0};
-        dummy->next.store(dummyNext, std::memory_order_relaxed);
+        Node* dummy = Freelist::create();
+        resetNext(dummy);
 
         // Initialize head/tail -> {dummy, 0}
         PtrVersion hv = {dummy, 0};
@@ -47,90 +98,103 @@ public:
         tail.store(hv, std::memory_order_relaxed);
     }
 
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
     ~LockFreeQueue() {
-        // In real production code, you'd need safe memory reclamation (hazard pointers, etc.)
-        // For the assignment, we do a naive cleanup:
-        while (deq() >= 0) { /* keep dequeuing until empty */ }
-        // Finally delete the dummy node
+        // No other thread uses the queue any more; retired nodes are recycled by the policy later
+        while (try_deq()) { /* keep dequeuing (and destroying items) until empty */ }
+        // Finally recycle the dummy node
         PtrVersion h = head.load(std::memory_order_relaxed);
-        delete reinterpret_cast<Node*>(h.ptr);
+        Freelist::destroy(reinterpret_cast<Node*>(h.ptr));
     }
 
     /**
-     * Enqueue integer v into the queue.
+     * Enqueue v into the queue.
      */
-    bool enq(int v) {
-        Node* newNode = new Node();
-        newNode->value = v;
-        PtrVersion nullNext = {nullptr, 0};
-        newNode->next.store(nullNext, std::memory_order_relaxed);
+    bool enq(const T& v) {
+        return emplace(v);
+    }
 
-        while (true) {
-            // Snapshot tail
-            PtrVersion tailSnap = tail.load(std::memory_order_acquire);
-            Node* tailPtr = reinterpret_cast<Node*>(tailSnap.ptr);
-            PtrVersion nextSnap = tailPtr->next.load(std::memory_order_acquire);
+    bool enq(T&& v) {
+        return emplace(std::move(v));
+    }
 
-            // If tailPtr is indeed the last node (next is null)
-            if (nextSnap.ptr == nullptr) {
-                // Attempt to link newNode as tailPtr->next
-                PtrVersion desiredNext = {newNode, nextSnap.version + 1};
+    // constructs the item in its node from args
+    template <typename... Args>
+    bool emplace(Args&&... args) {
+        Node* newNode = makeNode(std::forward<Args>(args)...);
+        linkChain(newNode, newNode);
+        nonEmpty.notify();
+        return true;
+    }
 
-                if (compareAndSwap128(tailPtr->next, nextSnap, desiredNext)) {
-                    // Successfully linked. Now move tail forward if needed
-                    PtrVersion desiredTail = {newNode, tailSnap.version + 1};
-                    compareAndSwap128(tail, tailSnap, desiredTail);
-                    return true;
-                }
-                // else someone else inserted => retry
-            } else {
-                // tail not pointing to the last node, fix it
-                PtrVersion desiredTail = {nextSnap.ptr, tailSnap.version + 1};
-                compareAndSwap128(tail, tailSnap, desiredTail);
-            }
+    /**
+     * Enqueue copies of values[0..n) in order. The nodes are linked into a private chain first,
+     * which is then spliced in with a single CAS on tail->next, so the n items appear at once and
+     * stay contiguous with respect to other producers.
+     */
+    bool enq_bulk(const T* values, size_t n) {
+        if (n == 0) {
+            return true;
         }
+        Node* first = makeNode(values[0]);
+        Node* last = first;
+        for (size_t i = 1; i < n; i++) {
+            Node* node = makeNode(values[i]);
+            PtrVersion link = {node, last->next.load(std::memory_order_relaxed).version + 1};
+            last->next.store(link, std::memory_order_relaxed);
+            last = node;
+        }
+        linkChain(first, last);
+        nonEmpty.notify((int)std::min(n, (size_t)INT_MAX));
+        return true;
     }
 
     /**
-     * Dequeue one item. Returns -1 if queue empty.
+     * Dequeue one item, or nullopt if the queue is empty.
      */
-    int deq() {
-        while (true) {
-            PtrVersion headSnap = head.load(std::memory_order_acquire);
-            PtrVersion tailSnap = tail.load(std::memory_order_acquire);
+    std::optional<T> try_deq() {
+        std::optional<T> result;
+        if (dequeue(1, [&](size_t, T&& item) { result.emplace(std::move(item)); }) == 0) {
+            // a copy from an attempt that lost its CAS
+            return std::nullopt;
+        }
+        return result;
+    }
 
-            Node* headPtr = reinterpret_cast<Node*>(headSnap.ptr);
-            Node* tailPtr = reinterpret_cast<Node*>(tailSnap.ptr);
+    /**
+     * Dequeue one item. Returns -1 if queue empty (LockFreeQueue<int> only, -1 can be an item).
+     */
+    int deq() {
+        static_assert(std::is_same<T, int>::value, "deq() is only for int queues, use try_deq()");
+        std::optional<T> item = try_deq();
+        return item ? *item : -1;
+    }
 
-            PtrVersion nextSnap = headPtr->next.load(std::memory_order_acquire);
-            Node* nextNode = reinterpret_cast<Node*>(nextSnap.ptr);
+    /**
+     * Dequeue one item, waiting for one if the queue is empty.
+     */
+    T deq_wait() {
+        return *waitForItem(nullptr);
+    }
 
-            // If head == tail => maybe empty
-            if (headPtr == tailPtr) {
-                if (nextNode == nullptr) {
-                    // Truly empty
-                    return -1;
-                }
-                // Tail is falling behind, push it forward
-                PtrVersion desiredTail = {nextNode, tailSnap.version + 1};
-                compareAndSwap128(tail, tailSnap, desiredTail);
-            } else {
-                // There's a real node to remove
-                if (nextNode == nullptr) {
-                    // Shouldn’t happen often if head != tail, but check
-                    return -1;
-                }
-                int value = nextNode->value;
+    /**
+     * Dequeue one item, waiting at most timeout for one; nullopt if none arrived in time.
+     */
+    template <typename Rep, typename Period>
+    std::optional<T> deq_for(const std::chrono::duration<Rep, Period>& timeout) {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+        return waitForItem(&deadline);
+    }
 
-                // Try to swing head to next
-                PtrVersion desiredHead = {nextNode, headSnap.version + 1};
-                if (compareAndSwap128(head, headSnap, desiredHead)) {
-                    delete headPtr; // reclaim old dummy node
-                    return value;
-                }
-                // else someone beat us => retry
-            }
-        }
+    /**
+     * Dequeue up to max items into out and return how many were taken (0 if the queue is empty).
+     * The items are detached with a single CAS that swings head over all of them; the walk stops
+     * at the tail snapshot, since head must never pass the tail.
+     */
+    size_t deq_bulk(T* out, size_t max) {
+        return dequeue(max, [&](size_t i, T&& item) { out[i] = std::move(item); });
     }
 
     /**
@@ -145,7 +209,7 @@ public:
         cur = reinterpret_cast<Node*>(nextSnap.ptr);
 
         while (cur) {
-            std::cout << cur->value << " ";
+            std::cout << *cur->item() << " ";
             nextSnap = cur->next.load(std::memory_order_acquire);
             cur = reinterpret_cast<Node*>(nextSnap.ptr);
         }
@@ -153,6 +217,186 @@ public:
     }
 
 private:
+    template <typename... Args>
+    static Node* makeNode(Args&&... args) {
+        Node* node = Freelist::create();
+        new (node->storage) T(std::forward<Args>(args)...);
+        resetNext(node);
+        return node;
+    }
+
+    /**
+     * Clears 'next' of a node fresh from the freelist, one version past its last value. A linker
+     * that still holds a {nullptr, v} snapshot from the node's previous life must not win its CAS
+     * against the new one, which would splice its chain behind a node that is no longer the tail.
+     */
+    static void resetNext(Node* node) {
+        PtrVersion old = node->next.load(std::memory_order_relaxed);
+        PtrVersion nullNext = {nullptr, old.version + 1};
+        node->next.store(nullNext, std::memory_order_relaxed);
+    }
+
+    /**
+     * Spins, then parks until try_deq succeeds or the deadline (if any) has passed.
+     */
+    std::optional<T> waitForItem(const std::chrono::steady_clock::time_point* deadline) {
+        for (int spin = 0; spin < QUEUE_SPINS_BEFORE_PARK; spin++) {
+            std::optional<T> item = try_deq();
+            if (item) {
+                return item;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+        while (true) {
+            EventCount::Key key = nonEmpty.prepareWait();
+            std::optional<T> item = try_deq();
+            if (item) {
+                nonEmpty.cancelWait();
+                return item;
+            }
+            int64_t timeoutNs = -1;
+            if (deadline) {
+                timeoutNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                *deadline - std::chrono::steady_clock::now()).count();
+                if (timeoutNs <= 0) {
+                    nonEmpty.cancelWait();
+                    return std::nullopt;
+                }
+            }
+            nonEmpty.wait(key, timeoutNs);
+        }
+    }
+
+    /**
+     * Detaches up to max items and passes them to sink(index, item) in queue order; returns how
+     * many. With EARLY_COPY the sink sees copies during the walk and may see them again after a
+     * failed CAS, otherwise it is only called for items this thread detached.
+     */
+    template <typename Sink>
+    size_t dequeue(size_t max, Sink sink) {
+        if (max == 0) {
+            return 0;
+        }
+        typename Reclaim::Guard guard;
+        while (true) {
+            PtrVersion headSnap = head.load(std::memory_order_acquire);
+            Node* headPtr = reinterpret_cast<Node*>(headSnap.ptr);
+            guard.protect(0, headPtr);
+            if (Reclaim::VALIDATE && !sameSnapshot(head.load(std::memory_order_acquire), headSnap)) {
+                continue;
+            }
+
+            PtrVersion tailSnap = tail.load(std::memory_order_acquire);
+            Node* tailPtr = reinterpret_cast<Node*>(tailSnap.ptr);
+
+            // Walk hand over hand: while head is unchanged every node up to the tail is still
+            // linked (and unretired), so one freshly protected node at a time is enough.
+            Node* last = headPtr;
+            size_t count = 0;
+            int slot = 0;
+            bool headMoved = false;
+            while (count < max) {
+                if (last == tailPtr && count > 0) {
+                    // head may catch up with the tail, but not pass it
+                    break;
+                }
+                PtrVersion nextSnap = last->next.load(std::memory_order_acquire);
+                Node* nextNode = reinterpret_cast<Node*>(nextSnap.ptr);
+                if (nextNode == nullptr) {
+                    break;
+                }
+                slot ^= 1;
+                guard.protect(slot, nextNode);
+                if (Reclaim::VALIDATE && !sameSnapshot(head.load(std::memory_order_acquire), headSnap)) {
+                    headMoved = true;
+                    break;
+                }
+                if (last == tailPtr) {
+                    // Tail is falling behind, push it forward and start over
+                    PtrVersion desiredTail = {nextNode, tailSnap.version + 1};
+                    compareAndSwap128(tail, tailSnap, desiredTail);
+                    headMoved = true;
+                    break;
+                }
+                if constexpr (EARLY_COPY) {
+                    sink(count, T(*nextNode->item()));
+                }
+                count++;
+                last = nextNode;
+            }
+            if (headMoved) {
+                continue;
+            }
+            if (count == 0) {
+                // Truly empty
+                return 0;
+            }
+
+            // Try to swing head over the detached nodes
+            PtrVersion desiredHead = {last, headSnap.version + 1};
+            if (compareAndSwap128(head, headSnap, desiredHead)) {
+                // take the items out of all detached nodes (the last one is the new dummy and
+                // still protected), then reclaim the old dummy and all of them but the last;
+                // read each link before the node is handed to the policy
+                Node* node = headPtr;
+                size_t i = 0;
+                while (node != last) {
+                    Node* next = reinterpret_cast<Node*>(node->next.load(std::memory_order_relaxed).ptr);
+                    if constexpr (!EARLY_COPY) {
+                        T* item = next->item();
+                        sink(i++, std::move(*item));
+                        item->~T();
+                    }
+                    Reclaim::retire(node, Freelist::destroyErased);
+                    node = next;
+                }
+                return count;
+            }
+            // else someone beat us => retry
+        }
+    }
+
+    /**
+     * Appends the chain first..last (already linked, last->next null) behind the current last node.
+     */
+    void linkChain(Node* first, Node* last) {
+        typename Reclaim::Guard guard;
+        while (true) {
+            // Snapshot tail
+            PtrVersion tailSnap = tail.load(std::memory_order_acquire);
+            Node* tailPtr = reinterpret_cast<Node*>(tailSnap.ptr);
+            guard.protect(0, tailPtr);
+            if (Reclaim::VALIDATE && !sameSnapshot(tail.load(std::memory_order_acquire), tailSnap)) {
+                continue;
+            }
+            PtrVersion nextSnap = tailPtr->next.load(std::memory_order_acquire);
+
+            // If tailPtr is indeed the last node (next is null)
+            if (nextSnap.ptr == nullptr) {
+                // Attempt to link newNode as tailPtr->next
+                PtrVersion desiredNext = {first, nextSnap.version + 1};
+
+                if (compareAndSwap128(tailPtr->next, nextSnap, desiredNext)) {
+                    // Successfully linked. Now move tail forward if needed
+                    PtrVersion desiredTail = {last, tailSnap.version + 1};
+                    compareAndSwap128(tail, tailSnap, desiredTail);
+                    return;
+                }
+                // else someone else inserted => retry
+            } else {
+                // tail not pointing to the last node, fix it
+                PtrVersion desiredTail = {nextSnap.ptr, tailSnap.version + 1};
+                compareAndSwap128(tail, tailSnap, desiredTail);
+            }
+        }
+    }
+
+    static bool sameSnapshot(const PtrVersion& a, const PtrVersion& b) {
+        return a.ptr == b.ptr && a.version == b.version;
+    }
+
     /**
      * 16-byte CAS on a std::atomic<PtrVersion>.
      * Returns true if it swapped, false otherwise.
@@ -0,0 +1,90 @@
+#ifndef EVENT_COUNT_H
+#define EVENT_COUNT_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Event count for parking threads that wait for a condition on a lock-free structure.
+ *
+ * A waiter registers with prepareWait(), re-checks its condition and then either cancels or calls
+ * wait() with the key it got, which sleeps on a futex until the epoch moves past the key. A
+ * notifier first makes the condition true and then calls notify(), which only bumps the epoch and
+ * enters the kernel if a waiter is registered, so the common case costs a fence and a load.
+ *
+ * Both sides put a seq_cst fence between their write (waiter count, condition) and their read
+ * (condition, waiter count), so either the waiter sees the condition or the notifier sees the
+ * waiter; and a waiter that registered before the epoch moved does not go to sleep.
+ */
+class EventCount {
+private:
+    std::atomic<uint32_t> epoch;
+    std::atomic<uint32_t> waiters;
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(int), "the futex word is an int");
+
+    int* futexWord() {
+        return reinterpret_cast<int*>(&epoch);
+    }
+
+public:
+    typedef uint32_t Key;
+
+    EventCount() : epoch(0), waiters(0) {}
+
+    EventCount(const EventCount&) = delete;
+    EventCount& operator=(const EventCount&) = delete;
+
+    // registers the caller as a waiter; re-check the condition before wait()
+    Key prepareWait() {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        Key key = epoch.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return key;
+    }
+
+    // the condition became true after prepareWait
+    void cancelWait() {
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Sleeps until a notify after prepareWait, for at most timeoutNs (negative: no limit). May
+     * return early (signals, spurious wakeups); the caller re-checks its condition either way.
+     */
+    void wait(Key key, int64_t timeoutNs = -1) {
+        if (epoch.load(std::memory_order_acquire) == key) {
+            struct timespec timeout;
+            struct timespec* timeoutPtr = nullptr;
+            if (timeoutNs >= 0) {
+                timeout.tv_sec = timeoutNs / 1000000000;
+                timeout.tv_nsec = timeoutNs % 1000000000;
+                timeoutPtr = &timeout;
+            }
+            syscall(SYS_futex, futexWord(), FUTEX_WAIT_PRIVATE, (int)key, timeoutPtr, nullptr, 0);
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // wakes up to count waiters, call after making the condition true
+    void notify(int count = 1) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        epoch.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, futexWord(), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+    void notifyAll() {
+        notify(INT_MAX);
+    }
+};
+
+#endif // EVENT_COUNT_H
@@ -0,0 +1,182 @@
+#ifndef FAA_QUEUE_H
+#define FAA_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+#include "reclamation.h"
+
+// items per segment of FAAArrayQueue
+#define FAA_SEGMENT_SIZE 1024
+
+/**
+ * Unbounded MPMC queue of ints in the style of the FAA-array queue (Ramalhete and Correia),
+ * a simpler relative of LCRQ.
+ *
+ * The queue is a linked list of segments, each an array of FAA_SEGMENT_SIZE item slots with its
+ * own enqueue and dequeue index. An operation claims a slot with one fetch-and-add on the index
+ * instead of retrying a CAS on a shared head or tail, so under contention every thread still
+ * makes progress with one atomic increment. A producer then stores its item into the slot with a
+ * CAS from EMPTY; a consumer swaps TAKEN into its slot, and if it got there first the producer's
+ * CAS fails and the producer claims another slot. Only when a segment is used up do threads CAS
+ * on the list: the producer that links a new segment puts its item in slot 0 of it.
+ *
+ * Unlinked segments go through the Reclaim policy (reclamation.h). Head and tail are plain
+ * pointers: the CAS that swings them only succeeds on a segment the caller has protected, so a
+ * segment can not be recycled under it (ImmediateReclamation gives no such guarantee and must
+ * not be used here). As in the Michael-Scott queue, a dequeuer swings a lagging tail before it
+ * moves head, so head never passes tail and a retired segment is unreachable from both.
+ */
+template <typename Reclaim = HazardPointerReclamation>
+class FAAArrayQueue {
+private:
+    static constexpr uint64_t EMPTY = 0;
+    static constexpr uint64_t TAKEN = 1;
+    // items are stored with this bit set, so no item looks like EMPTY or TAKEN
+    static constexpr uint64_t ITEM_BIT = 1ULL << 32;
+
+    struct Segment {
+        alignas(64) std::atomic<uint32_t> deqIdx;
+        alignas(64) std::atomic<uint32_t> enqIdx;
+        alignas(64) std::atomic<Segment*> next;
+        std::atomic<uint64_t> items[FAA_SEGMENT_SIZE];
+
+        // a segment made by an enqueuer starts with its item in slot 0
+        explicit Segment(uint64_t firstItem) : deqIdx(0), enqIdx(firstItem != EMPTY ? 1 : 0), next(nullptr) {
+            items[0].store(firstItem, std::memory_order_relaxed);
+            for (int i = 1; i < FAA_SEGMENT_SIZE; i++) {
+                items[i].store(EMPTY, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    alignas(64) std::atomic<Segment*> head;
+    alignas(64) std::atomic<Segment*> tail;
+
+    static uint64_t encode(int v) {
+        return ITEM_BIT | (uint32_t)v;
+    }
+
+    static int decode(uint64_t item) {
+        return (int)(uint32_t)item;
+    }
+
+    static void deleteSegment(void* segment) {
+        delete static_cast<Segment*>(segment);
+    }
+
+public:
+    FAAArrayQueue() {
+        Segment* first = new Segment(EMPTY);
+        head.store(first, std::memory_order_relaxed);
+        tail.store(first, std::memory_order_relaxed);
+    }
+
+    FAAArrayQueue(const FAAArrayQueue&) = delete;
+    FAAArrayQueue& operator=(const FAAArrayQueue&) = delete;
+
+    ~FAAArrayQueue() {
+        Segment* segment = head.load(std::memory_order_relaxed);
+        while (segment) {
+            Segment* next = segment->next.load(std::memory_order_relaxed);
+            delete segment;
+            segment = next;
+        }
+    }
+
+    /**
+     * Enqueue integer v. Never fails (the queue is unbounded).
+     */
+    bool enq(int v) {
+        typename Reclaim::Guard guard;
+        uint64_t item = encode(v);
+        while (true) {
+            Segment* ltail = tail.load(std::memory_order_acquire);
+            guard.protect(0, ltail);
+            if (Reclaim::VALIDATE && tail.load(std::memory_order_acquire) != ltail) {
+                continue;
+            }
+
+            uint32_t idx = ltail->enqIdx.fetch_add(1, std::memory_order_acq_rel);
+            if (idx < FAA_SEGMENT_SIZE) {
+                uint64_t expected = EMPTY;
+                if (ltail->items[idx].compare_exchange_strong(expected, item, std::memory_order_release,
+                                                              std::memory_order_relaxed)) {
+                    return true;
+                }
+                // a dequeuer took the slot before we filled it, claim another one
+                continue;
+            }
+
+            // segment full: append a new one (or help the thread that did)
+            if (tail.load(std::memory_order_acquire) != ltail) {
+                continue;
+            }
+            Segment* lnext = ltail->next.load(std::memory_order_acquire);
+            if (lnext == nullptr) {
+                Segment* fresh = new Segment(item);
+                Segment* expected = nullptr;
+                if (ltail->next.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) {
+                    tail.compare_exchange_strong(ltail, fresh, std::memory_order_acq_rel);
+                    return true;
+                }
+                delete fresh;
+            } else {
+                tail.compare_exchange_strong(ltail, lnext, std::memory_order_acq_rel);
+            }
+        }
+    }
+
+    /**
+     * Dequeue one item. Returns -1 if queue empty.
+     */
+    int deq() {
+        std::optional<int> item = try_deq();
+        return item ? *item : -1;
+    }
+
+    // like deq, but can also return negative values
+    std::optional<int> try_deq() {
+        typename Reclaim::Guard guard;
+        while (true) {
+            Segment* lhead = head.load(std::memory_order_acquire);
+            guard.protect(0, lhead);
+            if (Reclaim::VALIDATE && head.load(std::memory_order_acquire) != lhead) {
+                continue;
+            }
+
+            if (lhead->deqIdx.load(std::memory_order_acquire) >= lhead->enqIdx.load(std::memory_order_acquire) &&
+                lhead->next.load(std::memory_order_acquire) == nullptr) {
+                return std::nullopt;
+            }
+            uint32_t idx = lhead->deqIdx.fetch_add(1, std::memory_order_acq_rel);
+            if (idx >= FAA_SEGMENT_SIZE) {
+                // segment drained: move on to the next one
+                Segment* lnext = lhead->next.load(std::memory_order_acquire);
+                if (lnext == nullptr) {
+                    return std::nullopt;
+                }
+                // an enqueuer may have linked lnext without swinging tail yet: head must not pass
+                // tail, or the segment is retired while tail (and the enqueuers) still use it
+                Segment* ltail = tail.load(std::memory_order_acquire);
+                if (ltail == lhead) {
+                    tail.compare_exchange_strong(ltail, lnext, std::memory_order_acq_rel);
+                }
+                if (head.compare_exchange_strong(lhead, lnext, std::memory_order_acq_rel)) {
+                    // tail only moves forward and is past lhead now
+                    Reclaim::retire(lhead, deleteSegment);
+                }
+                continue;
+            }
+            uint64_t item = lhead->items[idx].exchange(TAKEN, std::memory_order_acq_rel);
+            if (item == EMPTY) {
+                // the producer of this slot has not stored yet; it will see TAKEN and retry
+                continue;
+            }
+            return decode(item);
+        }
+    }
+};
+
+#endif // FAA_QUEUE_H
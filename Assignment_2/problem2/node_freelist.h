@@ -0,0 +1,117 @@
+#ifndef NODE_FREELIST_H
+#define NODE_FREELIST_H
+
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// nodes moved between a thread's cache and the shared pool at a time
+#define FREELIST_BATCH 64
+
+/**
+ * Recycling allocator for queue nodes (one freelist per node type).
+ *
+ * Every thread keeps freed nodes in a private list and allocates from it without synchronization.
+ * Producers allocate and consumers free, so the lists drift apart: a thread whose list grows past
+ * two batches hands one batch to a shared pool, a thread whose list is empty takes a batch from
+ * there. The pool is a mutex-protected stack of batches, locked once per FREELIST_BATCH nodes.
+ * Memory is never returned to the system, which is what lets ImmediateReclamation get away with
+ * recycling nodes that stale readers may still look at. Fresh memory is zeroed, so a member that
+ * the Node constructor leaves alone starts at zero and then keeps its value across recycling.
+ */
+template <typename Node>
+class NodeFreelist {
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    static_assert(sizeof(Node) >= sizeof(FreeNode), "a free node must hold the list link");
+
+    struct LocalList {
+        FreeNode* head = nullptr;
+        size_t count = 0;
+
+        ~LocalList() {
+            while (count >= FREELIST_BATCH) {
+                giveBatch(*this);
+            }
+            if (count > 0) {
+                std::lock_guard<std::mutex> lock(poolLock);
+                pool.push_back(std::make_pair(head, count));
+            }
+        }
+    };
+
+    // batches of linked free nodes and their lengths; never destroyed, exiting threads still flush into it
+    static inline std::mutex poolLock;
+    static inline std::vector<std::pair<FreeNode*, size_t>>& pool = *new std::vector<std::pair<FreeNode*, size_t>>();
+
+    static LocalList& local() {
+        static thread_local LocalList list;
+        return list;
+    }
+
+    static void giveBatch(LocalList& list) {
+        FreeNode* first = list.head;
+        FreeNode* last = first;
+        for (int i = 1; i < FREELIST_BATCH; i++) {
+            last = last->next;
+        }
+        list.head = last->next;
+        list.count -= FREELIST_BATCH;
+        last->next = nullptr;
+
+        std::lock_guard<std::mutex> lock(poolLock);
+        pool.push_back(std::make_pair(first, (size_t)FREELIST_BATCH));
+    }
+
+    static bool takeBatch(LocalList& list) {
+        std::lock_guard<std::mutex> lock(poolLock);
+        if (pool.empty()) {
+            return false;
+        }
+        list.head = pool.back().first;
+        list.count = pool.back().second;
+        pool.pop_back();
+        return true;
+    }
+
+public:
+    template <typename... Args>
+    static Node* create(Args&&... args) {
+        LocalList& list = local();
+        void* memory;
+        if (list.head || takeBatch(list)) {
+            FreeNode* node = list.head;
+            list.head = node->next;
+            list.count--;
+            memory = node;
+        } else {
+            memory = ::operator new(sizeof(Node), std::align_val_t(alignof(Node)));
+            std::memset(memory, 0, sizeof(Node));
+        }
+        return new (memory) Node(std::forward<Args>(args)...);
+    }
+
+    static void destroy(Node* node) {
+        node->~Node();
+        LocalList& list = local();
+        FreeNode* freeNode = reinterpret_cast<FreeNode*>(node);
+        freeNode->next = list.head;
+        list.head = freeNode;
+        if (++list.count >= 2 * FREELIST_BATCH) {
+            giveBatch(list);
+        }
+    }
+
+    // deleter for the reclamation policies
+    static void destroyErased(void* node) {
+        destroy(static_cast<Node*>(node));
+    }
+};
+
+#endif // NODE_FREELIST_H
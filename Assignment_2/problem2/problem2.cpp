@@ -1,15 +1,22 @@
 #include <cassert>
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <random>
 #include <string>
+#include <thread>
 #include <pthread.h>
+#include <sys/resource.h>
 #include <vector>
 #include "concurrent_queue.h"
+#include "faa_queue.h"
+#include "ring_queue.h"
 
 using std::cout;
 using std::endl;
@@ -19,6 +26,7 @@ using HR = std::chrono::high_resolution_clock;
 using HRTimer = HR::time_point;
 using std::chrono::microseconds;
 using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
 using std::filesystem::path;
 
 static constexpr uint64_t RANDOM_SEED = 42;
@@ -28,29 +36,42 @@ uint64_t DELETE = 50;
 uint64_t runs = 1;
 int NUM_THREADS = 4;
 bool correctness_test = false;
+// reclamation scheme(s) to run: "hp", "ebr", "none" or "all"
+string RECLAMATION = "hp";
+// queue backend: "ms" (Michael-Scott list, LockFreeQueue), "ring" (bounded BoundedRingQueue),
+// "faa" (FAAArrayQueue) or "all"
+string BACKEND = "ms";
+uint64_t RING_CAPACITY = RING_DEFAULT_CAPACITY;
+// items per enq/deq call; above 1 the workers use enq_bulk / deq_bulk
+uint64_t BATCH_SIZE = 1;
+// pause of every latency-benchmark producer between two items; 0 runs the throughput benchmark
+uint64_t LATENCY_GAP_US = 0;
 
 typedef struct {
   uint32_t key;
   uint32_t value;
 } KeyValue;
 
+// every thread draws from its own generator, a shared one would be a data race
+template <typename Queue>
 struct ThreadArg {
   uint64_t startIdx;
   uint64_t endIdx;
   KeyValue* h_kvs_insert;
   uint32_t* h_keys_del;
-  LockFreeQueue* queue;
-  std::uniform_real_distribution<double>* dist;
-  std::mt19937* gen;
+  Queue* queue;
+  std::uniform_real_distribution<double> dist;
+  std::mt19937 gen;
   uint64_t ADD;
   uint64_t REM;
   bool verbose;
 };
 
+template <typename Queue>
 void* pthread_worker(void* arg) {
-  ThreadArg* args = static_cast<ThreadArg*>(arg);
+  ThreadArg<Queue>* args = static_cast<ThreadArg<Queue>*>(arg);
   for (uint64_t i = args->startIdx; i < args->endIdx; ++i) {
-    double randVal = (*(args->dist))(*(args->gen));
+    double randVal = args->dist(args->gen);
     if (randVal < INSERT && i < args->ADD) {
       args->queue->enq(args->h_kvs_insert[i].value);
       if (args->verbose) {
@@ -66,6 +87,64 @@ void* pthread_worker(void* arg) {
   pthread_exit(nullptr);
 }
 
+// queues without bulk operations get them one item at a time
+template <typename Queue>
+void enq_bulk(Queue& queue, const int* values, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    queue.enq(values[i]);
+  }
+}
+
+template <typename Reclaim>
+void enq_bulk(LockFreeQueue<int, Reclaim>& queue, const int* values, size_t n) {
+  queue.enq_bulk(values, n);
+}
+
+template <typename Queue>
+size_t deq_bulk(Queue& queue, int* out, size_t max) {
+  size_t n = 0;
+  while (n < max) {
+    std::optional<int> item = queue.try_deq();
+    if (!item) {
+      break;
+    }
+    out[n++] = *item;
+  }
+  return n;
+}
+
+template <typename Reclaim>
+size_t deq_bulk(LockFreeQueue<int, Reclaim>& queue, int* out, size_t max) {
+  return queue.deq_bulk(out, max);
+}
+
+// like pthread_worker, but every draw enqueues or dequeues the next BATCH_SIZE operations at once
+template <typename Queue>
+void* pthread_batch_worker(void* arg) {
+  ThreadArg<Queue>* args = static_cast<ThreadArg<Queue>*>(arg);
+  std::vector<int> batch(BATCH_SIZE);
+  for (uint64_t i = args->startIdx; i < args->endIdx; i += BATCH_SIZE) {
+    uint64_t end = std::min(i + BATCH_SIZE, args->endIdx);
+    double randVal = args->dist(args->gen);
+    if (randVal < INSERT && i < args->ADD) {
+      size_t n = 0;
+      for (uint64_t j = i; j < end && j < args->ADD; j++) {
+        batch[n++] = args->h_kvs_insert[j].value;
+      }
+      enq_bulk(*args->queue, batch.data(), n);
+      if (args->verbose) {
+        cout << "[Enq] " << n << " items from " << batch[0] << endl;
+      }
+    } else if (randVal < (INSERT + DELETE) && i < args->REM) {
+      size_t n = deq_bulk(*args->queue, batch.data(), std::min(end, args->REM) - i);
+      if (args->verbose) {
+        cout << "[Deq] " << n << " items" << endl;
+      }
+    }
+  }
+  pthread_exit(nullptr);
+}
+
 void read_data(path pth, uint64_t n, uint32_t* data) {
   FILE* fptr = fopen(pth.string().c_str(), "rb");
   if (!fptr) {
@@ -80,11 +159,13 @@ void read_data(path pth, uint64_t n, uint32_t* data) {
 }
 
 void validFlagsDescription() {
-  cout << "Usage: ./a.out -ops=<number_of_operations> -t=<num_threads> [-test]\n";
+  cout << "Usage: ./a.out -ops=<number_of_operations> -t=<num_threads> [-q=ms|ring|faa|all] [-cap=<ring_capacity>]"
+          " [-b=<batch_size>] [-rcl=hp|ebr|none|all]"
+          " [-lat=<gap_us>] [-test]\n";
 }
 
 int parse_args(int argc, char* argv[]) {
-  if (argc < 2 || argc > 4) {
+  if (argc < 2) {
     validFlagsDescription();
     return 1;
   }
@@ -106,6 +187,42 @@ int parse_args(int argc, char* argv[]) {
         cout << "Error: invalid number for -t (threads)\n";
         return 1;
       }
+    } else if (arg.substr(0, 3) == "-q=") {
+      BACKEND = arg.substr(3);
+      if (BACKEND != "ms" && BACKEND != "ring" && BACKEND != "faa" && BACKEND != "all") {
+        cout << "Error: -q must be ms, ring, faa or all\n";
+        return 1;
+      }
+    } else if (arg.substr(0, 5) == "-cap=") {
+      try {
+        RING_CAPACITY = std::stoull(arg.substr(5));
+        if (RING_CAPACITY == 0) throw std::invalid_argument("Invalid");
+      } catch (...) {
+        cout << "Error: invalid number for -cap\n";
+        return 1;
+      }
+    } else if (arg.substr(0, 3) == "-b=") {
+      try {
+        BATCH_SIZE = std::stoull(arg.substr(3));
+        if (BATCH_SIZE == 0) throw std::invalid_argument("Invalid");
+      } catch (...) {
+        cout << "Error: invalid number for -b (batch size)\n";
+        return 1;
+      }
+    } else if (arg.substr(0, 5) == "-lat=") {
+      try {
+        LATENCY_GAP_US = std::stoull(arg.substr(5));
+        if (LATENCY_GAP_US == 0) throw std::invalid_argument("Invalid");
+      } catch (...) {
+        cout << "Error: invalid number for -lat (microseconds)\n";
+        return 1;
+      }
+    } else if (arg.substr(0, 5) == "-rcl=") {
+      RECLAMATION = arg.substr(5);
+      if (RECLAMATION != "hp" && RECLAMATION != "ebr" && RECLAMATION != "none" && RECLAMATION != "all") {
+        cout << "Error: -rcl must be hp, ebr, none or all\n";
+        return 1;
+      }
     } else if (arg == "-test") {
       correctness_test = true;
     } else {
@@ -117,11 +234,185 @@ int parse_args(int argc, char* argv[]) {
   return 0;
 }
 
+// a fresh, empty queue of the given type; the ring is sized by -cap
+template <typename Queue>
+Queue* new_queue() {
+  return new Queue();
+}
+
+template <>
+BoundedRingQueue* new_queue<BoundedRingQueue>() {
+  return new BoundedRingQueue(RING_CAPACITY);
+}
+
+/**
+ * Runs the enq/deq mix on NUM_THREADS threads against a fresh Queue and prints the wall time
+ * and the throughput. Every run uses the same seeds, so the schemes see the same operations.
+ */
+template <typename Queue>
+void run_benchmark(const string& name, KeyValue* h_kvs_insert, uint32_t* h_keys_del, uint64_t ADD, uint64_t REM) {
+  std::unique_ptr<Queue> queue(new_queue<Queue>());
+  Queue& lfQueue = *queue;
+  auto start = HR::now();
+
+  std::vector<pthread_t> threads(NUM_THREADS);
+  std::vector<ThreadArg<Queue>> args(NUM_THREADS);
+
+  for (int t = 0; t < NUM_THREADS; t++) {
+    uint64_t chunkSize = NUM_OPS / NUM_THREADS;
+    uint64_t startIdx  = t * chunkSize;
+    uint64_t endIdx    = (t == NUM_THREADS - 1) ? NUM_OPS : (t + 1) * chunkSize;
+
+    args[t] = ThreadArg<Queue>{
+      .startIdx = startIdx,
+      .endIdx = endIdx,
+      .h_kvs_insert = h_kvs_insert,
+      .h_keys_del = h_keys_del,
+      .queue = &lfQueue,
+      .dist = std::uniform_real_distribution<double>(0.0, 100.0),
+      .gen = std::mt19937(RANDOM_SEED + t),
+      .ADD = ADD,
+      .REM = REM,
+      .verbose = correctness_test
+    };
+
+    pthread_create(&threads[t], nullptr, BATCH_SIZE > 1 ? pthread_batch_worker<Queue> : pthread_worker<Queue>,
+                   &args[t]);
+  }
+
+  for (int t = 0; t < NUM_THREADS; t++) {
+    pthread_join(threads[t], nullptr);
+  }
+
+  auto end = HR::now();
+  double totalTimeMs = duration_cast<milliseconds>(end - start).count();
+
+  cout << "\nQueue: " << name;
+  cout << "\nThreads: " << NUM_THREADS;
+  if (BATCH_SIZE > 1) {
+    cout << "\nBatch size: " << BATCH_SIZE;
+  }
+  if (correctness_test) {
+    cout << " (Correctness Test)";
+  }
+  cout << "\nTotal time (ms) for enq/deq: " << totalTimeMs << "\n";
+  cout << "Throughput (Mops/s): " << (totalTimeMs > 0 ? NUM_OPS / (totalTimeMs * 1000.0) : 0.0) << "\n";
+}
+
+// latency benchmark: items are enqueue timestamps, a negative item stops one consumer
+struct LatencyArg {
+  LockFreeQueue<int64_t>* queue;
+  uint64_t items;
+  bool park;
+  std::vector<int64_t> latencies;
+};
+
+int64_t now_ns() {
+  return duration_cast<nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// user + system CPU time of the whole process
+double cpu_time_ms() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+void* latency_producer(void* arg) {
+  LatencyArg* args = static_cast<LatencyArg*>(arg);
+  for (uint64_t i = 0; i < args->items; i++) {
+    std::this_thread::sleep_for(microseconds(LATENCY_GAP_US));
+    args->queue->enq(now_ns());
+  }
+  pthread_exit(nullptr);
+}
+
+void* latency_consumer(void* arg) {
+  LatencyArg* args = static_cast<LatencyArg*>(arg);
+  while (true) {
+    int64_t sent;
+    if (args->park) {
+      sent = args->queue->deq_wait();
+    } else {
+      std::optional<int64_t> item = args->queue->try_deq();
+      if (!item) {
+        continue;
+      }
+      sent = *item;
+    }
+    if (sent < 0) {
+      break;
+    }
+    args->latencies.push_back(now_ns() - sent);
+  }
+  pthread_exit(nullptr);
+}
+
+/**
+ * Half of the threads produce NUM_OPS items in total with a pause of LATENCY_GAP_US between two,
+ * the other half consume them either busy-polling try_deq or parking in deq_wait. Prints the
+ * enqueue-to-dequeue latency and the CPU time the process burnt meanwhile.
+ */
+void run_latency_benchmark(bool park) {
+  LockFreeQueue<int64_t> queue;
+  int producers = std::max(1, NUM_THREADS / 2);
+  int consumers = std::max(1, NUM_THREADS - producers);
+
+  std::vector<pthread_t> threads(producers + consumers);
+  std::vector<LatencyArg> args(producers + consumers);
+  double cpuStart = cpu_time_ms();
+  auto start = HR::now();
+
+  for (int t = 0; t < producers + consumers; t++) {
+    uint64_t items = t < producers ? NUM_OPS / producers + (t < (int)(NUM_OPS % producers)) : 0;
+    args[t] = LatencyArg{&queue, items, park, {}};
+    pthread_create(&threads[t], nullptr, t < producers ? latency_producer : latency_consumer, &args[t]);
+  }
+  for (int t = 0; t < producers; t++) {
+    pthread_join(threads[t], nullptr);
+  }
+  for (int t = 0; t < consumers; t++) {
+    queue.enq(-1);
+  }
+
+  std::vector<int64_t> latencies;
+  for (int t = producers; t < producers + consumers; t++) {
+    pthread_join(threads[t], nullptr);
+    latencies.insert(latencies.end(), args[t].latencies.begin(), args[t].latencies.end());
+  }
+
+  double wallMs = duration_cast<microseconds>(HR::now() - start).count() / 1000.0;
+  double cpuMs = cpu_time_ms() - cpuStart;
+  std::sort(latencies.begin(), latencies.end());
+  double sum = 0;
+  for (int64_t latency : latencies) {
+    sum += latency;
+  }
+  size_t n = latencies.size();
+
+  cout << "\nQueue: ms, hazard pointers, " << (park ? "parking" : "busy-polling") << " consumers";
+  cout << "\nProducers / consumers: " << producers << " / " << consumers;
+  cout << "\nGap between items (us): " << LATENCY_GAP_US << "\n";
+  if (n > 0) {
+    cout << "Latency (us) mean / p50 / p99: " << sum / n / 1000.0 << " / " << latencies[n / 2] / 1000.0 << " / "
+         << latencies[n * 99 / 100] / 1000.0 << "\n";
+  }
+  cout << "CPU time (ms): " << cpuMs << " in " << wallMs << " ms wall time (" << (wallMs > 0 ? cpuMs / wallMs : 0.0)
+       << " cores busy)\n";
+}
+
 int main(int argc, char* argv[]) {
   if (parse_args(argc, argv) != 0) {
     return EXIT_FAILURE;
   }
 
+  if (LATENCY_GAP_US > 0) {
+    run_latency_benchmark(false);
+    run_latency_benchmark(true);
+    return EXIT_SUCCESS;
+  }
+
   if (correctness_test) {
     cout << "\nRunning Correctness Test with " << NUM_OPS << " Operations...\n";
   }
@@ -153,48 +444,34 @@ int main(int argc, char* argv[]) {
   }
   delete[] tmp_keys_delete;
 
-  std::mt19937 gen(RANDOM_SEED);
-  std::uniform_real_distribution<double> dist(0.0, 100.0);
-
-  LockFreeQueue lfQueue;
-  auto start = HR::now();
-
-  std::vector<pthread_t> threads(NUM_THREADS);
-  std::vector<ThreadArg> args(NUM_THREADS);
-
-  for (int t = 0; t < NUM_THREADS; t++) {
-    uint64_t chunkSize = NUM_OPS / NUM_THREADS;
-    uint64_t startIdx  = t * chunkSize;
-    uint64_t endIdx    = (t == NUM_THREADS - 1) ? NUM_OPS : (t + 1) * chunkSize;
-
-    args[t] = ThreadArg{
-      .startIdx = startIdx,
-      .endIdx = endIdx,
-      .h_kvs_insert = h_kvs_insert,
-      .h_keys_del = h_keys_del,
-      .queue = &lfQueue,
-      .dist = &dist,
-      .gen = &gen,
-      .ADD = ADD,
-      .REM = REM,
-      .verbose = correctness_test
-    };
-
-    pthread_create(&threads[t], nullptr, pthread_worker, &args[t]);
+  bool all_backends = BACKEND == "all";
+  if (BACKEND == "ms" || all_backends) {
+    if (RECLAMATION == "hp" || RECLAMATION == "all") {
+      run_benchmark<LockFreeQueue<int, HazardPointerReclamation>>("ms, hazard pointers", h_kvs_insert, h_keys_del,
+                                                                  ADD, REM);
+    }
+    if (RECLAMATION == "ebr" || RECLAMATION == "all") {
+      run_benchmark<LockFreeQueue<int, EpochReclamation>>("ms, epochs", h_kvs_insert, h_keys_del, ADD, REM);
+    }
+    if (RECLAMATION == "none" || RECLAMATION == "all") {
+      run_benchmark<LockFreeQueue<int, ImmediateReclamation>>("ms, no reclamation (immediate reuse)", h_kvs_insert,
+                                                              h_keys_del, ADD, REM);
+    }
   }
-
-  for (int t = 0; t < NUM_THREADS; t++) {
-    pthread_join(threads[t], nullptr);
+  if (BACKEND == "ring" || all_backends) {
+    run_benchmark<BoundedRingQueue>("ring (capacity " + std::to_string(RING_CAPACITY) + ")", h_kvs_insert,
+                                    h_keys_del, ADD, REM);
   }
-
-  auto end = HR::now();
-  double totalTimeMs = duration_cast<milliseconds>(end - start).count();
-
-  cout << "\nThreads: " << NUM_THREADS;
-  if (correctness_test) {
-    cout << " (Correctness Test)\n";
+  // segments must not be reused while protected, so "none" falls back to hazard pointers
+  if (BACKEND == "faa" || all_backends) {
+    if (RECLAMATION != "ebr") {
+      run_benchmark<FAAArrayQueue<HazardPointerReclamation>>("faa array, hazard pointers", h_kvs_insert, h_keys_del,
+                                                             ADD, REM);
+    }
+    if (RECLAMATION == "ebr" || RECLAMATION == "all") {
+      run_benchmark<FAAArrayQueue<EpochReclamation>>("faa array, epochs", h_kvs_insert, h_keys_del, ADD, REM);
+    }
   }
-  cout << "Total time (ms) for enq/deq: " << totalTimeMs << "\n";
 
   delete[] h_kvs_insert;
   delete[] h_keys_del;
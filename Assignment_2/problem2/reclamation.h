@@ -0,0 +1,286 @@
+#ifndef RECLAMATION_H
+#define RECLAMATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Safe memory reclamation policies for the lock-free queue.
+ *
+ * A policy is a type with
+ *  - a nested Guard, created on the stack for the duration of one queue operation,
+ *  - Guard::protect(slot, ptr), which announces that ptr is about to be dereferenced,
+ *  - a constexpr bool VALIDATE: if true, the caller must re-read the location ptr was loaded from
+ *    after protect() and start over if it changed (hazard pointers),
+ *  - static retire(ptr, deleter), called once a node is unlinked; the deleter runs when no other
+ *    thread can still hold a reference.
+ *
+ * Every policy keeps one record per thread, adopted from a global list the first time a thread
+ * uses the policy and released (with whatever it still has to free) when the thread exits.
+ */
+
+// hazard pointer slots per thread: the queue protects at most two nodes at a time
+#define HAZARD_SLOTS 2
+// a thread scans the hazard pointers once it has this many retired nodes (at least)
+#define HAZARD_SCAN_MIN 64
+// retires between two attempts to advance the global epoch
+#define EPOCH_ADVANCE_INTERVAL 64
+
+struct RetiredNode {
+    void* ptr;
+    void (*deleter)(void*);
+};
+
+/**
+ * Record list shared by the policies: records are never freed, a thread that exits marks its
+ * record unused and the next new thread takes it over.
+ */
+template <typename Record>
+class ThreadRecords {
+private:
+    static inline std::atomic<Record*> records{nullptr};
+    static inline std::atomic<int> recordCount{0};
+
+    struct Owner {
+        Record* record = nullptr;
+        ~Owner() {
+            if (record) {
+                record->release();
+                record->inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    static Record* acquire() {
+        for (Record* r = records.load(std::memory_order_acquire); r; r = r->nextRecord) {
+            bool expected = false;
+            if (!r->inUse.load(std::memory_order_relaxed) && r->inUse.compare_exchange_strong(expected, true)) {
+                return r;
+            }
+        }
+        Record* r = new Record();
+        r->inUse.store(true, std::memory_order_relaxed);
+        Record* head = records.load(std::memory_order_relaxed);
+        do {
+            r->nextRecord = head;
+        } while (!records.compare_exchange_weak(head, r, std::memory_order_release, std::memory_order_relaxed));
+        recordCount.fetch_add(1, std::memory_order_relaxed);
+        return r;
+    }
+
+public:
+    static Record* mine() {
+        static thread_local Owner owner;
+        if (!owner.record) {
+            owner.record = acquire();
+        }
+        return owner.record;
+    }
+
+    static Record* first() {
+        return records.load(std::memory_order_acquire);
+    }
+
+    static int count() {
+        return recordCount.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Hazard pointers (Michael, 2004). Before dereferencing a node a thread publishes its address in
+ * one of its slots and checks that the node is still reachable; a retired node is only freed once
+ * no slot of any thread holds it. Each thread scans all slots when its retired list reaches
+ * max(HAZARD_SCAN_MIN, 2 * slots in use), so a scan frees at least half of the list.
+ */
+class HazardPointerReclamation {
+private:
+    struct Record {
+        std::atomic<void*> hazards[HAZARD_SLOTS];
+        std::vector<RetiredNode> retired;
+        std::atomic<bool> inUse{false};
+        Record* nextRecord = nullptr;
+
+        Record() {
+            for (std::atomic<void*>& hazard : hazards) {
+                hazard.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // the retired list stays with the record and is scanned by its next owner
+        void release() {
+            for (std::atomic<void*>& hazard : hazards) {
+                hazard.store(nullptr, std::memory_order_release);
+            }
+        }
+    };
+
+    using Records = ThreadRecords<Record>;
+
+    static void scan(Record* self) {
+        std::vector<void*> protectedPtrs;
+        for (Record* r = Records::first(); r; r = r->nextRecord) {
+            for (std::atomic<void*>& hazard : r->hazards) {
+                void* p = hazard.load(std::memory_order_seq_cst);
+                if (p) {
+                    protectedPtrs.push_back(p);
+                }
+            }
+        }
+        std::sort(protectedPtrs.begin(), protectedPtrs.end());
+
+        std::vector<RetiredNode> stillProtected;
+        for (const RetiredNode& node : self->retired) {
+            if (std::binary_search(protectedPtrs.begin(), protectedPtrs.end(), node.ptr)) {
+                stillProtected.push_back(node);
+            } else {
+                node.deleter(node.ptr);
+            }
+        }
+        self->retired.swap(stillProtected);
+    }
+
+public:
+    static constexpr bool VALIDATE = true;
+
+    class Guard {
+    private:
+        Record* record;
+
+    public:
+        Guard() : record(Records::mine()) {}
+
+        ~Guard() {
+            for (std::atomic<void*>& hazard : record->hazards) {
+                hazard.store(nullptr, std::memory_order_release);
+            }
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        // seq_cst so that the following re-read of the source can not pass the announcement
+        void protect(int slot, void* ptr) {
+            record->hazards[slot].store(ptr, std::memory_order_seq_cst);
+        }
+    };
+
+    static void retire(void* ptr, void (*deleter)(void*)) {
+        Record* self = Records::mine();
+        self->retired.push_back(RetiredNode{ptr, deleter});
+        size_t threshold = std::max((size_t)HAZARD_SCAN_MIN, (size_t)(2 * HAZARD_SLOTS * Records::count()));
+        if (self->retired.size() >= threshold) {
+            scan(self);
+        }
+    }
+};
+
+/**
+ * Epoch-based reclamation (Fraser, 2004). A thread announces the global epoch while it runs an
+ * operation; the epoch only advances once every active thread has announced the current one.
+ * A node retired in epoch e can no longer be referenced once the epoch reached e + 2; it is freed
+ * when its thread reuses the bag of e, at epoch e + 3. Guards cost two stores and a fence and
+ * need no validation, but one stalled thread holds back all frees.
+ */
+class EpochReclamation {
+private:
+    static constexpr uint64_t ACTIVE = 1;
+    static inline std::atomic<uint64_t> globalEpoch{0};
+
+    struct Record {
+        std::atomic<uint64_t> announced{0};    // epoch << 1 | ACTIVE while in an operation
+        std::vector<RetiredNode> bags[3];
+        uint64_t bagEpoch[3] = {0, 0, 0};
+        uint64_t retireCount = 0;
+        std::atomic<bool> inUse{false};
+        Record* nextRecord = nullptr;
+
+        // the bags stay with the record and are freed by its next owner
+        void release() {}
+    };
+
+    using Records = ThreadRecords<Record>;
+
+    static void tryAdvance() {
+        uint64_t epoch = globalEpoch.load(std::memory_order_seq_cst);
+        for (Record* r = Records::first(); r; r = r->nextRecord) {
+            uint64_t announced = r->announced.load(std::memory_order_seq_cst);
+            if ((announced & ACTIVE) && (announced >> 1) != epoch) {
+                return;
+            }
+        }
+        globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+    }
+
+    static void freeBag(std::vector<RetiredNode>& bag) {
+        for (const RetiredNode& node : bag) {
+            node.deleter(node.ptr);
+        }
+        bag.clear();
+    }
+
+public:
+    static constexpr bool VALIDATE = false;
+
+    class Guard {
+    private:
+        Record* record;
+
+    public:
+        Guard() : record(Records::mine()) {
+            record->announced.store(globalEpoch.load(std::memory_order_relaxed) << 1 | ACTIVE,
+                                    std::memory_order_relaxed);
+            // the announcement must be visible before any node is read
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        ~Guard() {
+            record->announced.store(0, std::memory_order_release);
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        void protect(int, void*) {}
+    };
+
+    static void retire(void* ptr, void (*deleter)(void*)) {
+        Record* self = Records::mine();
+        uint64_t epoch = globalEpoch.load(std::memory_order_acquire);
+        int b = (int)(epoch % 3);
+        if (self->bagEpoch[b] != epoch) {
+            // filled at epoch - 3 or earlier
+            freeBag(self->bags[b]);
+            self->bagEpoch[b] = epoch;
+        }
+        self->bags[b].push_back(RetiredNode{ptr, deleter});
+        if (++self->retireCount % EPOCH_ADVANCE_INTERVAL == 0) {
+            tryAdvance();
+        }
+    }
+};
+
+/**
+ * Frees (recycles) a node as soon as it is unlinked, as the queue originally did. Safe only
+ * because queue nodes come from NodeFreelist and are never returned to the system, and because
+ * every versioned word of a node (head, tail and a node's 'next') only ever moves to a higher
+ * version, also across recycling: a stale reader sees a recycled node and its versioned CAS fails.
+ * It still reads memory another thread writes, which is a data race. Kept as the baseline the
+ * other policies are measured against.
+ */
+class ImmediateReclamation {
+public:
+    static constexpr bool VALIDATE = false;
+
+    class Guard {
+    public:
+        void protect(int, void*) {}
+    };
+
+    static void retire(void* ptr, void (*deleter)(void*)) {
+        deleter(ptr);
+    }
+};
+
+#endif // RECLAMATION_H
@@ -0,0 +1,156 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// capacity of a BoundedRingQueue built without one
+#define RING_DEFAULT_CAPACITY (1 << 16)
+// failed attempts a blocking call spins before it starts yielding the CPU
+#define RING_SPINS_BEFORE_YIELD 64
+
+/**
+ * Bounded multi-producer multi-consumer queue of ints on a ring of cells (Vyukov).
+ *
+ * Every cell carries a sequence number that says whose turn it is: cell i is free for the
+ * producer of position pos when sequence == pos, and holds the item for the consumer of pos when
+ * sequence == pos + 1. A producer claims a position with one CAS on enqueuePos, writes the value
+ * and publishes it by storing sequence = pos + 1; the consumer of that position frees the cell for
+ * the next lap by storing sequence = pos + capacity. No allocation, no pointer chasing, and
+ * producers and consumers only meet on the cells they hand over.
+ *
+ * Same interface as LockFreeQueue<int>: enq returns false if the queue is full, deq returns -1 and
+ * try_deq returns nullopt if it is empty. enq_blocking / deq_blocking wait instead (spin, then
+ * yield).
+ */
+class BoundedRingQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        int value;
+    };
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    Cell* cells;
+    size_t mask;
+    alignas(CACHE_LINE) std::atomic<size_t> enqueuePos;
+    alignas(CACHE_LINE) std::atomic<size_t> dequeuePos;
+
+    static void backoff(int attempt) {
+        if (attempt < RING_SPINS_BEFORE_YIELD) {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+public:
+    // the capacity is rounded up to a power of two
+    explicit BoundedRingQueue(size_t capacity = RING_DEFAULT_CAPACITY) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        cells = new Cell[size];
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    ~BoundedRingQueue() {
+        delete[] cells;
+    }
+
+    BoundedRingQueue(const BoundedRingQueue&) = delete;
+    BoundedRingQueue& operator=(const BoundedRingQueue&) = delete;
+
+    /**
+     * Enqueue integer v. Returns false if the queue is full.
+     */
+    bool enq(int v) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = v;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+                // pos was reloaded by the failed CAS
+            } else if (diff < 0) {
+                // the consumer of the previous lap has not freed the cell: full
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Dequeue one item. Returns -1 if queue empty.
+     */
+    int deq() {
+        std::optional<int> item = try_deq();
+        return item ? *item : -1;
+    }
+
+    // like deq, but can also return negative values
+    std::optional<int> try_deq() {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    int value = cell.value;
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return value;
+                }
+            } else if (diff < 0) {
+                // the producer of this position has not published yet: empty
+                return std::nullopt;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // waits until there is room for v
+    void enq_blocking(int v) {
+        for (int attempt = 0; !enq(v); attempt += attempt < RING_SPINS_BEFORE_YIELD) {
+            backoff(attempt);
+        }
+    }
+
+    // waits until an item is available
+    int deq_blocking() {
+        std::optional<int> item;
+        for (int attempt = 0; !(item = try_deq()); attempt += attempt < RING_SPINS_BEFORE_YIELD) {
+            backoff(attempt);
+        }
+        return *item;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+};
+
+#endif // RING_QUEUE_H